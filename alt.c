@@ -24,37 +24,83 @@
 #include "dbg.h"
 
 
-// forward references
-static void altEnabling(Process *proc);
-static _Bool altShouldWait(Process *proc);
-static void altFinish(Process *proc);
-
 // earliest timeout in alt
 #define NO_TIME MAX_TIME
 
+// sets guard's type, and the fields every guard starts out with
+// (enabled, with weight 1 and no credit)
+#define INIT_GUARD(guard, t) \
+  ((guard)->type = (t), (guard)->enabled = true, \
+   (guard)->weight = 1, (guard)->credit = 0)
+
 /** Initializes channel guard */
 inline void init_channel_guard(Guard *guard, Channel *chan) {
-    guard->type = GUARD_CHAN;
+    INIT_GUARD(guard, GUARD_CHAN);
     guard->channel = chan;
 }
 
+/** Initializes output guard (ready when the channel's reader is
+ *  waiting; on selection, the process must write to the channel) */
+inline void init_output_guard(Guard *guard, Channel *chan) {
+    INIT_GUARD(guard, GUARD_OUT);
+    guard->channel = chan;
+}
+
+/** Initializes call channel guard (ready when a client calls; 
+ *  on selection, the process must accept the call) */
+inline void init_call_guard(Guard *guard, CallChannel *cchan) {
+    init_channel_guard(guard, &cchan->chan);
+}
+
+/** Initializes sample channel guard (ready when channel holds
+ *  a value not yet read) */
+inline void init_sample_guard(Guard *guard, SampleChannel *sc) {
+    INIT_GUARD(guard, GUARD_SAMPLE);
+    guard->sample = sc;
+}
+
 /** Initializes skip guard */
 inline void init_skip_guard(Guard *guard) {
-    guard->type = GUARD_SKIP;
+    INIT_GUARD(guard, GUARD_SKIP);
 }
 
 /** Initializes timer guard */
 inline void init_timer_guard(Guard *guard, Time time) {
-    guard->type = GUARD_TIMER;
+    INIT_GUARD(guard, GUARD_TIMER);
     guard->time = time;
 }
 
-/** Initializes interrupt guard */
+/** Initializes interrupt guard (ready when the interrupt fires while
+ *  the guard is enabled; see get_interrupt) */
 inline void init_interrupt_guard(Guard *guard, Interrupt *interrupt) {
-    guard->type = GUARD_INTERRUPT;
+    INIT_GUARD(guard, GUARD_INTERRUPT);
     guard->interrupt = interrupt;
 }
 
+/** Initializes channel group guard (ready when a writer is waiting
+ *  on any member; on selection, the process must take a member with
+ *  group_member and read from it) */
+inline void init_group_guard(Guard *guard, ChannelGroup *group) {
+    INIT_GUARD(guard, GUARD_GROUP);
+    guard->group = group;
+}
+
+/** Sets guard's precondition: a disabled guard is skipped by the 
+ *  selection functions (and so is never selected) until re-enabled */
+inline void set_guard_enabled(Guard *guard, _Bool enabled) {
+    guard->enabled = enabled;
+}
+
+/** Sets guard's weight, its share of selections by weightedSelect
+ *  relative to the other guards (guards start out with weight 1).
+ *  Weights beyond GUARD_MAX_WEIGHT are taken as GUARD_MAX_WEIGHT. */
+inline void set_guard_weight(Guard *guard, uint16 weight) {
+    if (weight > GUARD_MAX_WEIGHT) 
+        weight = GUARD_MAX_WEIGHT;
+    guard->weight = (weight > 0) ? weight : 1;
+    guard->credit = 0;
+}
+
 /** Initializes alternation */
 inline void init_alt(Alternation *alt, Guard *guards, int size) {
     alt->favorite = 0;
@@ -62,41 +108,103 @@ inline void init_alt(Alternation *alt, Guard *guards, int size) {
     alt->nrGuards = size;
 }
 
+static void group_ready(ChannelGroup *group, int index);
+static _Bool enable_group(ChannelGroup *group, Process *proc);
+static _Bool disable_group(ChannelGroup *group, Process *proc);
+
+/** Enables guard for alt, returns true if guard ready.
+ *  Keeps track of the earliest timeout in 'earliest'. */
+static _Bool enable_guard(Guard *guard, Process *proc, Time *earliest)
+{
+    // guard whose precondition is false is never ready
+    if (!guard->enabled) return false;
+
+    switch (guard->type) 
+    {
+        case GUARD_CHAN:
+            return enable_channel(guard->channel, proc);
+        case GUARD_SAMPLE:
+            return enable_sample(guard->sample, proc);
+        case GUARD_OUT:
+            return enable_output(guard->channel, proc);
+        case GUARD_SKIP:
+            // skip guard always ready
+            return true;
+        case GUARD_INTERRUPT:
+            return enable_interrupt(guard->interrupt, proc);
+        case GUARD_GROUP:
+            return enable_group(guard->group, proc);
+        case GUARD_TIMER:
+            if (guard->time < *earliest) {
+                *earliest = guard->time;
+            }
+            return enable_timeout(guard->time, proc);
+    }
+    return false;
+}
+
+/** Disables guard for alt, returns true if guard ready */
+static _Bool disable_guard(Guard *guard, Process *proc)
+{
+    // guard whose precondition is false was never enabled
+    if (!guard->enabled) return false;
+
+    switch (guard->type)
+    {
+        case GUARD_CHAN:
+            return disable_channel(guard->channel, proc);
+        case GUARD_SAMPLE:
+            return disable_sample(guard->sample, proc);
+        case GUARD_OUT:
+            return disable_output(guard->channel, proc);
+        case GUARD_SKIP:
+            // skip guard always ready
+            return true;
+        case GUARD_TIMER:
+            return disable_timeout(guard->time, proc);
+        case GUARD_INTERRUPT:
+            return disable_interrupt(guard->interrupt, proc);
+        case GUARD_GROUP:
+            return disable_group(guard->group, proc);
+    }
+    return false;
+}
+
+/** Releases the claim on a guard's channel found ready in the
+ *  disable pass but not selected, so its writer (or, for an output
+ *  guard, its reader) may withdraw */
+static void release_guard(Guard *guard)
+{
+    if (guard->type == GUARD_CHAN || guard->type == GUARD_OUT) {
+        unclaim_channel(guard->channel);
+    }
+}
+
 /** Select first ready alternative */
 int priSelect(Alternation *alt)
 {  
-    int selected = -1;
+    int selected;
     Process *proc = get_current();
 
+Restart_pri:
+    selected = -1;
+
     // mark process 'enabling'
     altEnabling(proc);
 
     // keep track of earliest timeout (if any) in Alt
     Time earliest = NO_TIME;
 
+    // whether any guard is enabled (otherwise nothing can
+    // make the alt ready)
+    _Bool any_enabled = false;
+
     int i;
     for (i = 0; i < alt->nrGuards; i++)
     {
-        _Bool ready;
-        Guard *guard = &(alt->guards[i]);
-        switch (guard->type) 
-        {
-            case GUARD_CHAN:
-                ready = enable_channel(guard->channel, proc);
-                if (ready) goto Found_pri;
-                break;
-            case GUARD_SKIP:
-                // skip guard always ready
-                goto Found_pri;  
-                break;
-            case GUARD_TIMER:
-                if (guard->time < earliest) {
-                    earliest = guard->time;
-                }
-                ready = enable_timeout(guard->time, proc);
-                if (ready) goto Found_pri;
-                break;
-        }
+        any_enabled |= alt->guards[i].enabled;
+        if (enable_guard(&alt->guards[i], proc, &earliest)) 
+            goto Found_pri;
     }
     i--;   // step back one
 
@@ -111,8 +219,9 @@ int priSelect(Alternation *alt)
 
     // still no ready guard
 
-    // if alt not ready, relinquish processor
-    if (altShouldWait(proc)) {
+    // if alt not ready, relinquish processor (unless every 
+    // guard is disabled, in which case none is selected)
+    if (any_enabled && altShouldWait(proc)) {
         relinquish_unconditional();
     }
     // when reach here, alt is ready 
@@ -120,30 +229,29 @@ int priSelect(Alternation *alt)
 Found_pri:
     for (; i >=0; i--)
     {
-        _Bool ready;
-        Guard *guard = &(alt->guards[i]);
-        switch (guard->type)
-        {
-            case GUARD_CHAN:
-                ready = disable_channel(guard->channel, proc);
-                if (ready) selected = i;
-                break;
-            
-            case GUARD_SKIP:
-                // skip guard always ready
-                selected = i;   
-                break;
-
-            case GUARD_TIMER:
-                ready = disable_timeout(guard->time, proc);
-                if (ready) selected = i;
-                break;
+        if (disable_guard(&alt->guards[i], proc)) {
+            // an earlier ready guard displaces the one found before
+            if (selected >= 0) 
+                release_guard(&alt->guards[selected]);
+            selected = i;
         }
     }
 
     // mark this process finished with the alt
     altFinish(proc);
 
+    // freed by a writer that withdrew before the disable 
+    // pass got to it: nothing is ready after all
+    if (selected < 0 && any_enabled) 
+        goto Restart_pri;
+
+    // an interrupt, once selected, is consumed
+    if (selected >= 0 && alt->guards[selected].type == GUARD_INTERRUPT) {
+        accept_interrupt(alt->guards[selected].interrupt);
+    }
+    if (selected < 0) 
+        return selected;
+
     // save starting point in case next use of
     // this alt is for a fairSelect
     alt->favorite = selected + 1;
@@ -154,14 +262,14 @@ Found_pri:
     return selected;
 }
 
-/** Select ready alternative */
-int fairSelect(Alternation *alt)
+/** Select first ready alternative searching cyclically from 'start' */
+static int select_from(Alternation *alt, int start)
 {  
-    int selected = -1;
+    int selected;
     Process *proc = get_current();
 
-    // allow favorite to have an uninitialized value on first fairSelect
-    //alt->favorite = abs(alt->favorite) % alt->nrGuards;
+Restart_fair:
+    selected = -1;
 
     // mark process 'enabling'
     altEnabling(proc);
@@ -169,32 +277,19 @@ int fairSelect(Alternation *alt)
     // keep track of earliest timeout (if any) in Alt
     Time earliest = NO_TIME;
 
+    // whether any guard is enabled (otherwise nothing can
+    // make the alt ready)
+    _Bool any_enabled = false;
+
     int k;
     int i;
-    for (k = 0, i = alt->favorite; 
+    for (k = 0, i = start; 
          k < alt->nrGuards; 
          k++, i = (i + 1) % alt->nrGuards) 
     {
-        _Bool ready;
-        Guard *guard = &(alt->guards[i]);
-        switch (guard->type) 
-        {
-            case GUARD_CHAN:
-                ready = enable_channel(guard->channel, proc);
-                if (ready) goto Found_fair;
-                break;
-            case GUARD_SKIP:
-                // skip guard always ready
-                goto Found_fair;  
-                break;
-            case GUARD_TIMER:
-                if (guard->time < earliest) {
-                    earliest = guard->time;
-                }
-                ready = enable_timeout(guard->time, proc);
-                if (ready) goto Found_fair;
-                break;
-        }
+        any_enabled |= alt->guards[i].enabled;
+        if (enable_guard(&alt->guards[i], proc, &earliest)) 
+            goto Found_fair;
     }
     k--;
     i = (i - 1 + alt->nrGuards) % alt->nrGuards;
@@ -210,8 +305,9 @@ int fairSelect(Alternation *alt)
 
     // still no ready guard
 
-    // if alt not ready, relinquish processor
-    if (altShouldWait(proc)) {
+    // if alt not ready, relinquish processor (unless every 
+    // guard is disabled, in which case none is selected)
+    if (any_enabled && altShouldWait(proc)) {
         relinquish_unconditional();
     }
     // when reach here, alt is ready 
@@ -219,30 +315,41 @@ int fairSelect(Alternation *alt)
 Found_fair:
     for (; k >= 0; k--, i = (i - 1 + alt->nrGuards) % alt->nrGuards)
     {
-        _Bool ready;
-        Guard *guard = &(alt->guards[i]);
-        switch (guard->type)
-        {
-            case GUARD_CHAN:
-                ready = disable_channel(guard->channel, proc);
-                if (ready) selected = i;
-                break;
-            
-            case GUARD_SKIP:
-                // skip guard always ready
-                selected = i;   
-                break;
-
-            case GUARD_TIMER:
-                ready = disable_timeout(guard->time, proc);
-                if (ready) selected = i;
-                break;
+        if (disable_guard(&alt->guards[i], proc)) {
+            // an earlier ready guard displaces the one found before
+            if (selected >= 0) 
+                release_guard(&alt->guards[selected]);
+            selected = i;
         }
     }
 
     // mark this process finished with the alt
     altFinish(proc);
 
+    // freed by a writer that withdrew before the disable 
+    // pass got to it: nothing is ready after all
+    if (selected < 0 && any_enabled) 
+        goto Restart_fair;
+
+    // an interrupt, once selected, is consumed
+    if (selected >= 0 && alt->guards[selected].type == GUARD_INTERRUPT) {
+        accept_interrupt(alt->guards[selected].interrupt);
+    }
+
+    // return index of selected branch of alt
+    return selected;
+}
+
+/** Select ready alternative */
+int fairSelect(Alternation *alt)
+{
+    // allow favorite to have an uninitialized value on first fairSelect
+    //alt->favorite = abs(alt->favorite) % alt->nrGuards;
+
+    int selected = select_from(alt, alt->favorite);
+    if (selected < 0) 
+        return selected;
+
     // save starting point in case next use of
     // this alt is for a fairSelect
     alt->favorite = selected + 1;
@@ -253,6 +360,445 @@ Found_fair:
     return selected;
 }
 
+/** 
+ *  Select ready alternative, giving each guard a share of selections
+ *  in proportion to its weight (deficit round robin).  The guard
+ *  whose turn it is stays selected while it is ready and has credit;
+ *  it is granted its weight in credit when its turn begins, and each
+ *  selection spends one unit.  A guard that is not ready when its 
+ *  turn comes forfeits its turn and any credit left over.
+ */
+int weightedSelect(Alternation *alt)
+{
+    int start = alt->favorite;
+    int selected = select_from(alt, start);
+    if (selected < 0) 
+        return selected;
+
+    // guards passed over were not ready and lose their turn
+    int i;
+    for (i = start; i != selected; i = (i + 1) % alt->nrGuards) {
+        alt->guards[i].credit = 0;
+    }
+
+    // selected guard's turn: spend a unit of credit
+    Guard *guard = &alt->guards[selected];
+    if (guard->credit == 0) {
+        guard->credit = guard->weight;
+    }
+    guard->credit--;
+
+    // keep the turn while credit remains
+    alt->favorite = selected;
+    if (guard->credit == 0) {
+        alt->favorite = selected + 1;
+        if (alt->favorite >= alt->nrGuards) 
+            alt->favorite -= alt->nrGuards;
+    }
+
+    // return index of selected branch of alt
+    return selected;
+}
+
+/** 
+ *  Select all ready alternatives.  Enables every guard (rather than
+ *  stopping at the first ready one), waits if none is ready, and
+ *  returns the number of guards found ready in the disable pass, 
+ *  putting their indexes in 'ready' in ascending order.  'ready'
+ *  must have room for all the guards.  The process must by 
+ *  convention service every guard returned (read each input
+ *  channel, write each output channel).
+ */
+int selectAll(Alternation *alt, uint16 ready[])
+{
+    Process *proc = get_current();
+
+Restart_all:
+    // mark process 'enabling'
+    altEnabling(proc);
+
+    // keep track of earliest timeout (if any) in Alt
+    // (each timer guard enables its own timeout)
+    Time earliest = NO_TIME;
+
+    _Bool any = false;
+    _Bool any_enabled = false;
+    int i;
+    for (i = 0; i < alt->nrGuards; i++)
+    {
+        if (enable_guard(&alt->guards[i], proc, &earliest)) 
+            any = true;
+        any_enabled |= alt->guards[i].enabled;
+    }
+
+    // if alt not ready, relinquish processor (unless every 
+    // guard is disabled, in which case none is selected)
+    if (!any && any_enabled && altShouldWait(proc)) {
+        relinquish_unconditional();
+    }
+    // when reach here, alt is ready 
+
+    // disable every guard, collecting the ready ones
+    int n = 0;
+    for (i = 0; i < alt->nrGuards; i++)
+    {
+        if (disable_guard(&alt->guards[i], proc)) 
+            ready[n++] = i;
+    }
+
+    // mark this process finished with the alt
+    altFinish(proc);
+
+    // freed by a writer that withdrew before the disable 
+    // pass got to it: nothing is ready after all
+    if (n == 0 && any_enabled) 
+        goto Restart_all;
+
+    // interrupts, once selected, are consumed
+    int j;
+    for (j = 0; j < n; j++) {
+        if (alt->guards[ready[j]].type == GUARD_INTERRUPT) {
+            accept_interrupt(alt->guards[ready[j]].interrupt);
+        }
+    }
+
+    // save starting point in case next use of
+    // this alt is for a fairSelect
+    if (n > 0) {
+        alt->favorite = ready[n-1] + 1;
+        if (alt->favorite >= alt->nrGuards) 
+            alt->favorite -= alt->nrGuards;
+    }
+
+    // return number of ready guards
+    return n;
+}
+
+/*---------------------------------------------------------------------
+ |  A persistent alternation registers its guards with their channels
+ |  once, rather than enabling and disabling every guard on every
+ |  selection.  A writer that finds no reader waiting on a registered
+ |  channel pushes the channel's guard onto the alternation's ready
+ |  set, a lock-free stack, and frees the alting process if it is 
+ |  waiting.  A selection takes the whole stack at once and serves the
+ |  guards in the order they became ready, so it costs time in
+ |  proportion to the number of ready guards, not of all guards.
+ |
+ |  The alting process must read a registered channel only after 
+ |  selecting it, and a registered channel must not also appear in
+ |  an ordinary alternation, nor be written by an output guard.
+ *--------------------------------------------------------------------*/
+
+/** Initializes persistent alternation over the given channels */
+void init_persistent_alt(PersistentAlt *alt, PGuard *guards, 
+                             Channel *chans[], int size)
+{
+    atomic_init(&alt->ready, NULL);
+    alt->taken = NULL;
+    atomic_init(&alt->waiting, NULL);
+    alt->nrGuards = size;
+    alt->guards = guards;
+
+    int i;
+    for (i = 0; i < size; i++)
+    {
+        PGuard *pguard = &guards[i];
+        Channel *chan = chans[i];
+        pguard->channel = chan;
+        pguard->alt = alt;
+        pguard->group = NULL;
+        pguard->next = NULL;
+        atomic_init(&pguard->queued, false);
+        pguard->index = i;
+
+        // register guard with channel; if a writer 
+        // is already offering data, the guard is ready
+        claim_mutex(&chan->mutex);
+        if (chan->waiting != NULL && chan->alting) {
+            plotz("Alternation at both ends of channel");
+        }
+        chan->pguard = pguard;
+        _Bool ready = (chan->waiting != NULL && !chan->alting);
+        release_mutex(&chan->mutex);
+        if (ready) {
+            pguard_ready(pguard);
+        }
+    }
+}
+
+/** Unregisters persistent alternation's guards from their channels */
+void close_persistent_alt(PersistentAlt *alt)
+{
+    int i;
+    for (i = 0; i < alt->nrGuards; i++) {
+        Channel *chan = alt->guards[i].channel;
+        claim_mutex(&chan->mutex);
+        chan->pguard = NULL;
+        release_mutex(&chan->mutex);
+    }
+}
+
+/** Puts guard on its persistent alternation's ready set */
+void pguard_ready(PGuard *pguard)
+{
+    if (pguard->group != NULL) {
+        group_ready(pguard->group, pguard->index);
+        return;
+    }
+
+    PersistentAlt *alt = pguard->alt;
+
+    // if guard already in ready set (a writer withdrew and came
+    // back before the alting process got to it), leave it there
+    if (atomic_exchange(&pguard->queued, true)) {
+        return;
+    }
+
+    // push guard onto ready stack
+    PGuard *head = atomic_load_explicit(&alt->ready, memory_order_acquire);
+    do {
+        pguard->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(
+                &alt->ready, &head, pguard, 
+                memory_order_acq_rel, memory_order_acquire));
+
+    // if alting process waiting, free it
+    Process *proc = atomic_exchange(&alt->waiting, NULL);
+    if (proc != NULL) {
+        int old_state = atomic_exchange_explicit(
+            &proc->sched_state, PROC_READY, memory_order_acq_rel);
+        if (old_state == PROC_WAITING) {
+            schedule(proc);
+        }
+    }
+}
+
+/** Select ready channel of persistent alternation */
+int persistentSelect(PersistentAlt *alt)
+{
+    Process *proc = get_current();
+    while (true)
+    {
+        // serve guards already taken from the ready stack
+        while (alt->taken != NULL) 
+        {
+            PGuard *pguard = alt->taken;
+            alt->taken = pguard->next;
+            atomic_store(&pguard->queued, false);
+
+            // make sure writer is still there (it may 
+            // have withdrawn, as out_until can), and if
+            // so hold it to its offer
+            Channel *chan = pguard->channel;
+            claim_mutex(&chan->mutex);
+            _Bool ready = (chan->waiting != NULL && !chan->alting);
+            if (ready) {
+                chan->claimed = true;
+            }
+            release_mutex(&chan->mutex);
+            if (ready) {
+                return pguard->index;
+            }
+        }
+
+        // take the whole ready stack, reversing it 
+        // so guards are served in order of readiness
+        PGuard *pguard = atomic_exchange(&alt->ready, NULL);
+        while (pguard != NULL) {
+            PGuard *next = pguard->next;
+            pguard->next = alt->taken;
+            alt->taken = pguard;
+            pguard = next;
+        }
+        if (alt->taken != NULL) {
+            continue;
+        }
+
+        // nothing ready: let writers know this process is waiting,
+        // then look again in case a writer came by in the meantime
+        PREPARE_TO_WAIT(proc);
+        atomic_store(&alt->waiting, proc);
+        if (atomic_load(&alt->ready) != NULL) {
+            if (atomic_exchange(&alt->waiting, NULL) == proc) {
+                // withdrew before writer saw us
+                atomic_store_explicit(&proc->sched_state, 
+                    PROC_READY, memory_order_release);
+            } else {
+                // writer is freeing us: let it finish
+                relinquish();
+            }
+        } else {
+            relinquish();
+        }
+    }
+}
+
+/*---------------------------------------------------------------------
+ |  A channel group is a persistent registration, like the above, that
+ |  sits in an ordinary alternation as one guard.  A writer that finds
+ |  no reader waiting on a member channel sets the member's bit in the
+ |  group's ready bitmap and frees the alting process if the group 
+ |  guard is enabled.  Enabling and disabling the guard scan the bitmap
+ |  32 members at a time rather than locking every channel, and 
+ |  group_member finds a ready member with a bit scan.
+ |
+ |  The same restrictions apply as for persistent alternation: a 
+ |  member must be read only after group_member has returned it.
+ *--------------------------------------------------------------------*/
+
+/** Initializes group over the given channels */
+void init_channel_group(ChannelGroup *group, Channel *chans,
+                            PGuard *members, int size)
+{
+    if (size < 1) {
+        plotz("No channels in group");
+    }
+    if (size > GROUP_MAX_CHANS) {
+        plotz("Too many channels in group");
+    }
+
+    int w;
+    for (w = 0; w < GROUP_WORDS; w++) {
+        atomic_init(&group->ready[w], 0);
+    }
+    atomic_init(&group->waiting, NULL);
+    group->favorite = 0;
+    group->nrChans = size;
+    group->chans = chans;
+    group->members = members;
+
+    int i;
+    for (i = 0; i < size; i++)
+    {
+        PGuard *pguard = &members[i];
+        Channel *chan = &chans[i];
+        pguard->channel = chan;
+        pguard->alt = NULL;
+        pguard->group = group;
+        pguard->next = NULL;
+        atomic_init(&pguard->queued, false);
+        pguard->index = i;
+
+        // register member with channel; if a writer 
+        // is already offering data, the member is ready
+        claim_mutex(&chan->mutex);
+        if (chan->waiting != NULL && chan->alting) {
+            plotz("Alternation at both ends of channel");
+        }
+        chan->pguard = pguard;
+        _Bool ready = (chan->waiting != NULL && !chan->alting);
+        release_mutex(&chan->mutex);
+        if (ready) {
+            group_ready(group, i);
+        }
+    }
+}
+
+/** Unregisters channel group's members from their channels */
+void close_channel_group(ChannelGroup *group)
+{
+    int i;
+    for (i = 0; i < group->nrChans; i++) {
+        Channel *chan = &group->chans[i];
+        claim_mutex(&chan->mutex);
+        chan->pguard = NULL;
+        release_mutex(&chan->mutex);
+    }
+}
+
+/** Marks group member ready (called by the member's writer) */
+static void group_ready(ChannelGroup *group, int index)
+{
+    atomic_fetch_or(&group->ready[index / 32], 1u << (index % 32));
+
+    // if group guard enabled, free the alting process
+    Process *proc = atomic_exchange(&group->waiting, NULL);
+    if (proc != NULL) {
+        freeProcessMaybe(proc);
+    }
+}
+
+/** Returns true if any member of group ready */
+static _Bool any_member_ready(ChannelGroup *group)
+{
+    int nwords = (group->nrChans + 31) / 32;
+    int w;
+    for (w = 0; w < nwords; w++) {
+        if (atomic_load(&group->ready[w]) != 0) 
+            return true;
+    }
+    return false;
+}
+
+/** Enables group guard, returns true if guard ready */
+static _Bool enable_group(ChannelGroup *group, Process *proc)
+{
+    // publish proc before looking at the bitmap, so a writer 
+    // setting its bit afterwards is sure to see it
+    atomic_store(&group->waiting, proc);
+    return any_member_ready(group);
+}
+
+/** Disables group guard, returns true if guard ready */
+static _Bool disable_group(ChannelGroup *group, Process *proc)
+{
+    atomic_store(&group->waiting, NULL);
+    return any_member_ready(group);
+}
+
+/** Returns the first member with its ready bit set, searching 
+ *  cyclically from 'start', or -1 if none */
+static int scan_ready(ChannelGroup *group, int start)
+{
+    int nwords = (group->nrChans + 31) / 32;
+    int w = start / 32;
+    uint32 low = ~(~0u << (start % 32));    // bits below 'start'
+    uint32 mask = ~low;
+    int k;
+    // visit the starting word twice: first the bits at or 
+    // above 'start', at the end the bits below it
+    for (k = 0; k <= nwords; k++) {
+        uint32 bits = atomic_load(&group->ready[w]) & mask;
+        if (bits != 0) {
+            return w * 32 + __builtin_ctz(bits);
+        }
+        mask = (k == nwords - 1) ? low : ~0u;
+        w = (w + 1) % nwords;
+    }
+    return -1;
+}
+
+/** Takes a ready member of a selected channel group */
+int group_member(ChannelGroup *group, _Bool fair)
+{
+    int start = fair ? group->favorite : 0;
+    int index;
+    while ((index = scan_ready(group, start)) >= 0)
+    {
+        // take the member out of the ready set
+        atomic_fetch_and(&group->ready[index / 32], 
+                         ~(1u << (index % 32)));
+
+        // a writer that timed out may have withdrawn, so make 
+        // sure one is still waiting, and if so hold it to its offer
+        Channel *chan = &group->chans[index];
+        claim_mutex(&chan->mutex);
+        _Bool ready = (chan->waiting != NULL && !chan->alting);
+        if (ready) {
+            chan->claimed = true;
+        }
+        release_mutex(&chan->mutex);
+        if (ready) {
+            group->favorite = index + 1;
+            if (group->favorite >= group->nrChans)
+                group->favorite = 0;
+            return index;
+        }
+    }
+    return -1;
+}
+
+/** Frees alting process if necessary */
 void freeProcessMaybe(Process *proc)
 {
     // attempt to transition from Enabling to Ready
@@ -289,15 +835,47 @@ void freeProcessMaybe(Process *proc)
     }
 }
 
+/** Frees alting process if appropriate.  Called from an interrupt
+ *  handler, with interrupts disabled, for a process on this unit. */
+void freeProcessMaybe0(Process *proc)
+{
+    // attempt transition from Enabling to Ready
+    uint8 expected = ALT_ENABLING;
+    _Bool successful = atomic_compare_exchange_strong_explicit(
+        &proc->alt_state, &expected, ALT_READY,
+        memory_order_acq_rel, memory_order_relaxed);
+    // if successful, the process is running, so can just return
+    // if not successful, the actual value may be Ready, Waiting
+    // or None.  If Ready, someone beat us to it and we can just
+    // return.  If None, the process is finished with the Alt
+    // and we can just return.
+            
+    // if found process waiting, attempt transition from
+    // Waiting to Ready
+    if (expected == ALT_WAITING) {
+        successful = atomic_compare_exchange_strong_explicit(
+            &proc->alt_state, &expected, ALT_READY,
+            memory_order_acq_rel, memory_order_relaxed);
+
+        // if successful, we found process waiting and need
+        // to put it on its ready queue
+        if (successful) {
+            enqueue0(proc);
+        }
+        // if not successful, someone already put the process
+        // in the ready state, so just return
+    }
+}
+
 /** Transition to Enabling state. */
-static void altEnabling(Process *proc)
+void altEnabling(Process *proc)
 {
     atomic_store_explicit(&proc->alt_state, ALT_ENABLING, memory_order_release);
 }
 
 /** Try to transition from Enabling to Waiting and return
  *  indication of success. */
-static _Bool altShouldWait(Process *proc)
+_Bool altShouldWait(Process *proc)
 {
     uint8 expected = ALT_ENABLING;
     _Bool successful = atomic_compare_exchange_strong_explicit(
@@ -308,7 +886,7 @@ static _Bool altShouldWait(Process *proc)
 }
 
 /** Transition to not alting. */
-static void altFinish(Process *proc)
+void altFinish(Process *proc)
 {
     atomic_store_explicit(&proc->alt_state, ALT_NONE, memory_order_release);
 }
@@ -22,6 +22,7 @@
 #include "types.h"
 #include "comm.h"
 #include "interrupt.h"
+#include "sample.h"
 #include "sched.h"
 
 // guard types
@@ -29,6 +30,9 @@
 #define GUARD_SKIP       1
 #define GUARD_TIMER      2
 #define GUARD_INTERRUPT  3
+#define GUARD_SAMPLE     4
+#define GUARD_OUT        5
+#define GUARD_GROUP      6
 
 // alt states
 #define ALT_NONE     0
@@ -36,14 +40,39 @@
 #define ALT_WAITING  2
 #define ALT_READY    3
     
-/** Guard */
+// most channels in a channel group
+#define GROUP_MAX_CHANS  1024
+#define GROUP_WORDS      (GROUP_MAX_CHANS / 32)
+
+/** Group of like channels that appears in an alternation as a single
+ *  guard.  Each member channel's writer sets the member's bit in the
+ *  ready bitmap; selection scans the bitmap a word at a time. */
+typedef struct ChannelGroup {
+    _Atomic(uint32) ready[GROUP_WORDS];   // member has a writer waiting
+    _Atomic(Process *) waiting;   // alting process, while guard enabled
+    uint16 favorite;              // where fair scan starts
+    uint16 nrChans;
+    Channel *chans;               // the member channels
+    PGuard *members;              // registration of each member
+} ChannelGroup;
+
+// most weight a guard can have in weightedSelect
+#define GUARD_MAX_WEIGHT  255
+
+/** Guard (type, precondition and weight share the word before the
+ *  union, so they add nothing to the size of a guard) */
 typedef struct Guard {
 
-    uint16 type;
+    uint8 type;
+    _Bool enabled;                        // precondition
+    uint8 weight;                         // share in weightedSelect
+    uint8 credit;                         // selections left in turn
     union {
         Channel *channel;                 
         Time time;
         Interrupt *interrupt;
+        SampleChannel *sample;
+        ChannelGroup *group;
     };
 
 } Guard;
@@ -55,9 +84,39 @@ typedef struct Alternation {
     Guard *guards;
 } Alternation;
 
+/** Guard of a persistent alternation.  Stays registered with its
+ *  channel between selections; the channel's writer puts it on the
+ *  alternation's ready set. */
+typedef struct PGuard {
+    Channel *channel;             // the channel
+    struct PersistentAlt *alt;    // the alternation
+    ChannelGroup *group;          // or the channel group
+    PGuard *next;                 // next in ready set
+    _Atomic(_Bool) queued;        // guard is in ready set
+    uint16 index;                 // index of guard in alternation
+} PGuard;
+
+/** State info for persistent alternation */
+typedef struct PersistentAlt {
+    _Atomic(PGuard *) ready;      // guards made ready (lock-free stack)
+    PGuard *taken;                // guards taken from stack, in order
+    _Atomic(Process *) waiting;   // alting process, if waiting
+    uint16 nrGuards;
+    PGuard *guards;
+} PersistentAlt;
+
 /** Initializes channel guard */
 inline void init_channel_guard(Guard *guard, Channel *chan);
 
+/** Initializes output guard */
+inline void init_output_guard(Guard *guard, Channel *chan);
+
+/** Initializes call channel guard */
+inline void init_call_guard(Guard *guard, CallChannel *cchan);
+
+/** Initializes sample channel guard */
+inline void init_sample_guard(Guard *guard, SampleChannel *sc);
+
 /** Initializes skip guard */
 inline void init_skip_guard(Guard *guard);
 
@@ -67,16 +126,78 @@ inline void init_timer_guard(Guard *guard, Time time);
 /** Initializes interrupt guard */
 inline void init_interrupt_guard(Guard *guard, Interrupt *interrupt);
 
+/** Initializes channel group guard */
+inline void init_group_guard(Guard *guard, ChannelGroup *group);
+
+/** Sets guard's precondition (guards start out enabled) */
+inline void set_guard_enabled(Guard *guard, _Bool enabled);
+
+/** Sets guard's weight for weightedSelect, 1 .. GUARD_MAX_WEIGHT
+ *  (guards start out with 1) */
+inline void set_guard_weight(Guard *guard, uint16 weight);
+
 /** Initializes alternation */
 inline void init_alt(Alternation *alt, Guard *guards, int size);
 
-/** Select first ready alternative */
+/** Select first ready alternative (-1 if every guard disabled) */
 int priSelect(Alternation *alt);
 
-/** Select ready alternative */
+/** Select ready alternative (-1 if every guard disabled) */
 int fairSelect(Alternation *alt);
 
+/** Select ready alternative, sharing selections by guard weight 
+ *  (-1 if every guard disabled) */
+int weightedSelect(Alternation *alt);
+
+/** Select all ready alternatives, returning how many there are 
+ *  (0 if every guard disabled) */
+int selectAll(Alternation *alt, uint16 ready[]);
+
+/** Initializes persistent alternation over the given channels, 
+ *  registering a guard (from 'guards') with each channel */
+void init_persistent_alt(PersistentAlt *alt, PGuard *guards, 
+                             Channel *chans[], int size);
+
+/** Unregisters persistent alternation's guards from their channels */
+void close_persistent_alt(PersistentAlt *alt);
+
+/** Select ready channel of persistent alternation, in order of readiness */
+int persistentSelect(PersistentAlt *alt);
+
+/** Initializes group over 'size' channels (array 'chans'), 
+ *  registering a guard (from 'members') with each channel */
+void init_channel_group(ChannelGroup *group, Channel *chans,
+                            PGuard *members, int size);
+
+/** Unregisters channel group's members from their channels */
+void close_channel_group(ChannelGroup *group);
+
+/** Takes a ready member of a selected channel group, returning its 
+ *  index or -1 if none.  Scans from the member after the last one 
+ *  taken if 'fair' is true, otherwise from the lowest index. */
+int group_member(ChannelGroup *group, _Bool fair);
+
+/** Puts guard on its persistent alternation's ready set (called
+ *  by the channel's writer) */
+void pguard_ready(PGuard *pguard);
+
 /** Frees alting process if necessary */
 void freeProcessMaybe(Process *proc);
 
+/** Frees alting process if necessary.
+ *  Interrupts must be disabled when calling this function. */
+void freeProcessMaybe0(Process *proc);
+
+// The alt state transitions below are used by alternation 
+// and by extended input (see comm.c)
+
+/** Transition to Enabling state */
+void altEnabling(Process *proc);
+
+/** Try to transition from Enabling to Waiting; returns true if successful */
+_Bool altShouldWait(Process *proc);
+
+/** Transition to not alting */
+void altFinish(Process *proc);
+
 #endif
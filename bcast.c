@@ -0,0 +1,223 @@
+
+/**
+ *  CXP   C eXecutive Program
+ *  Copyright (c) 2014 Michael E. Goldsby
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bcast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dbg.h"
+
+/** Initializes broadcast channel; quorum of zero means all subscribers */
+void init_broadcast(Broadcast *bcast, uint quorum)
+{
+    init_mutex(&bcast->mutex);
+    bcast->writer = NULL;
+    bcast->src = NULL;
+    bcast->len = 0;
+    bcast->readers = NULL;
+    bcast->round = 0;
+    bcast->nsubs = 0;
+    bcast->quorum = quorum;
+    bcast->needed = 0;
+    bcast->taken = 0;
+    bcast->committed = 0;
+}
+
+/** Subscribes reader to broadcast channel */
+void subscribe(Broadcast *bcast, Subscription *sub)
+{
+    claim_mutex(&bcast->mutex);   // claim exclusive access to this channel
+    sub->bcast = bcast;
+    sub->proc = NULL;
+    sub->next = NULL;
+    sub->round = bcast->round;    // wait for next value
+    sub->committed = false;
+    // (a value already on offer counts only the subscribers
+    // there were when it was offered, so needs nothing from this one)
+    bcast->nsubs += 1;
+    release_mutex(&bcast->mutex);   // release exclusive access
+}
+
+/** Releases writer if the readers needed have taken its value 
+ *  and none is still due to.  Caller must hold the channel's mutex; 
+ *  it is released. */
+static void release_writer_maybe(Broadcast *bcast)
+{
+    if (bcast->writer != NULL && bcast->taken >= bcast->needed 
+            && bcast->taken == bcast->committed) 
+    {
+        // last reader needed: release writer
+        Process *wasWaiting = bcast->writer;
+        bcast->writer = NULL;
+        bcast->src = NULL;
+        release_mutex(&bcast->mutex);   // release exclusive access
+
+        // make the writing process ready
+        int old_state = atomic_exchange_explicit(
+            &wasWaiting->sched_state, PROC_READY, memory_order_acq_rel);
+
+        // if writing process was waiting, schedule it
+        if (old_state == PROC_WAITING) {
+            schedule(wasWaiting);
+        }
+    }
+    else
+    {
+        release_mutex(&bcast->mutex);   // release exclusive access
+    }
+}
+
+/** Copies current value to reader and releases writer 
+ *  if this reader completes the quorum */
+static void take(Subscription *sub, Word *paramDest, uint len)
+{
+    Broadcast *bcast = sub->bcast;
+
+    // writer cannot leave until this reader is counted,
+    // so can copy its data without holding the mutex
+    memcpy(paramDest, bcast->src, len);
+    sub->round = bcast->round;
+
+    claim_mutex(&bcast->mutex);   // claim exclusive access to this channel
+    sub->committed = false;
+    bcast->taken += 1;
+    release_writer_maybe(bcast);
+}
+
+/** Withdraws reader's subscription from its broadcast channel */
+void unsubscribe(Subscription *sub)
+{
+    Broadcast *bcast = sub->bcast;
+    claim_mutex(&bcast->mutex);   // claim exclusive access to this channel
+    bcast->nsubs -= 1;
+
+    // if waiting for a value, leave the waiting readers
+    Subscription **link = &bcast->readers;
+    while (*link != NULL && *link != sub) {
+        link = &(*link)->next;
+    }
+    if (*link == sub) {
+        *link = sub->next;
+        sub->next = NULL;
+        sub->proc = NULL;
+    }
+
+    // a value on offer that this reader was counted on (due to
+    // take it, or needed for a quorum of all) no longer waits for it
+    if (bcast->writer != NULL && sub->round != bcast->round) {
+        if (sub->committed) {
+            sub->committed = false;
+            bcast->committed -= 1;
+        }
+        if (bcast->quorum == 0) {
+            bcast->needed -= 1;
+        }
+    }
+    release_writer_maybe(bcast);
+}
+
+/** Reads next value from broadcast channel */
+void bcast_in(Subscription *sub, Word *paramDest, uint len)
+{
+    Broadcast *bcast = sub->bcast;
+    Process *curr = get_current();
+    claim_mutex(&bcast->mutex);   // claim exclusive access to this channel
+    if (bcast->writer != NULL && sub->round != bcast->round)
+    {
+        // writer is offering a value this reader has not taken
+        sub->committed = true;
+        bcast->committed += 1;
+        release_mutex(&bcast->mutex);   // release exclusive access
+    }
+    else
+    {
+        // no new value, so wait for writer
+        sub->proc = curr;
+        sub->next = bcast->readers;
+        bcast->readers = sub;
+        PREPARE_TO_WAIT(curr);
+        release_mutex(&bcast->mutex);   // release exclusive access
+        relinquish();
+        // when this process resumes, the writer is offering
+        // a value and has counted this reader as committed
+    }
+    take(sub, paramDest, len);
+}
+
+/** Writes value to broadcast channel */
+void bcast_out(Broadcast *bcast, Word *paramSrc, uint len)
+{
+    Process *curr = get_current();
+    claim_mutex(&bcast->mutex);   // claim exclusive access to this channel
+
+    // fix the number of readers needed for this value now, 
+    // so that later subscribers do not change it
+    if (bcast->quorum > bcast->nsubs) {
+        plotz("Broadcast quorum exceeds subscribers");
+    }
+    bcast->needed = (bcast->quorum != 0 ? bcast->quorum : bcast->nsubs);
+
+    // offer the value
+    bcast->writer = curr;
+    bcast->src = paramSrc;
+    bcast->len = len;
+    bcast->round += 1;
+    bcast->taken = 0;
+
+    // take all waiting readers, committing them to this value
+    Subscription *sub = bcast->readers;
+    bcast->readers = NULL;
+    uint16 committed = 0;
+    Process *wake = NULL;
+    while (sub != NULL) 
+    {
+        Process *reader = sub->proc;
+        sub->proc = NULL;
+        sub->committed = true;
+        sub = sub->next;
+        committed += 1;
+
+        // make the reading process ready
+        int old_state = atomic_exchange_explicit(
+            &reader->sched_state, PROC_READY, memory_order_acq_rel);
+
+        // if reading process was waiting, it is in no queue,
+        // so can chain it for scheduling (otherwise, state was
+        // PROC_PREPARING_TO_WAIT, and reader will not wait)
+        if (old_state == PROC_WAITING) {
+            reader->next = wake;
+            wake = reader;
+        }
+    }
+    bcast->committed = committed;
+    if (bcast->needed == 0)
+    {
+        // no subscribers: nothing to wait for
+        bcast->writer = NULL;
+        bcast->src = NULL;
+        release_mutex(&bcast->mutex);   // release exclusive access
+        return;
+    }
+    PREPARE_TO_WAIT(curr);
+    release_mutex(&bcast->mutex);   // release exclusive access
+
+    // wake readers together, then wait for the quorum
+    schedule_batch(wake);
+    relinquish();
+    // when this process resumes, the quorum has taken the value
+}
@@ -0,0 +1,81 @@
+
+/**
+ *  CXP   C eXecutive Program
+ *  Copyright (c) 2014 Michael E. Goldsby
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BCAST_H
+#define BCAST_H
+
+#include "mutex.h"
+#include "sched.h"
+#include "types.h"
+
+/*---------------------------------------------------------------------
+ |  A broadcast channel carries each value from one writer to many
+ |  readers.  Readers subscribe to the channel first, and unsubscribe
+ |  when they stop reading (or terminate).  An 'out' on it completes
+ |  once a quorum of the subscribers (by default, all of them) have
+ |  taken the value.  Readers copy the value straight
+ |  from the writer's buffer, so the writer makes no copies at all,
+ |  and the writer wakes the readers waiting for it as a batch.
+ *--------------------------------------------------------------------*/
+
+typedef struct Broadcast Broadcast;
+typedef struct Subscription Subscription;
+
+/** A reader's subscription to a broadcast channel */
+typedef struct Subscription {
+    Broadcast *bcast;         // the channel
+    Process *proc;            // reader, while waiting
+    Subscription *next;       // next waiting reader
+    uint32 round;             // last value taken
+    _Bool committed;          // counted as due to take current value
+} Subscription;
+
+typedef struct Broadcast {
+    Mutex mutex;
+    Process *writer;          // writer waiting for readers, if any
+    Word *src;                // writer's data
+    uint len;                 // length of writer's data
+    Subscription *readers;    // readers waiting for a value
+    uint32 round;             // number of values written
+    uint16 nsubs;             // number of subscribers
+    uint16 quorum;            // readers needed to release writer (0: all)
+    uint16 needed;            // readers needed for current value
+    uint16 taken;             // readers that have taken current value
+    uint16 committed;         // readers due to take current value
+} Broadcast;
+
+/** Initializes broadcast channel; quorum of zero means all subscribers
+ *  (a nonzero quorum must not exceed the subscribers when writing) */
+void init_broadcast(Broadcast *bcast, uint quorum);
+
+/** Subscribes reader to broadcast channel (subscription receives 
+ *  only values written after it subscribes) */
+void subscribe(Broadcast *bcast, Subscription *sub);
+
+/** Withdraws reader's subscription from its broadcast channel (a 
+ *  value on offer that the reader has not taken no longer waits 
+ *  for it) */
+void unsubscribe(Subscription *sub);
+
+/** Reads next value from broadcast channel */
+void bcast_in(Subscription *sub, Word *paramDest, uint len);
+
+/** Writes value to broadcast channel */
+void bcast_out(Broadcast *bcast, Word *paramSrc, uint len);
+
+#endif
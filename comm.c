@@ -18,6 +18,8 @@
 
 #include "comm.h"
 #include "alt.h"
+#include "memory.h"
+#include "timer.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,6 +31,160 @@ void init_channel(Channel *chan)
     init_mutex(&chan->mutex);
     chan->waiting = NULL;
     chan->src = NULL;
+    chan->pguard = NULL;
+    chan->alting = false;
+    chan->claimed = false;
+    chan->expired = false;
+}
+
+/** Initializes given array of padded channels */
+void init_channel_array(PaddedChannel *chans, uint n)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        init_channel(&chans[i].chan);
+    }
+}
+
+/** Records where an allocated channel array came from; 
+ *  sits just below the (aligned) array. */
+typedef struct ChannelArrayHeader {
+    byte *block;        // block allocated for the array
+    uint16 index;       // memory class of the block
+} ChannelArrayHeader;
+
+/** Allocates and initializes a cache-aligned array of padded channels,
+ *  returning NULL if the array cannot be allocated */
+PaddedChannel *allocate_channels(uint n)
+{
+    // leave room for the header and for aligning the array
+    uint extra = sizeof(ChannelArrayHeader) + CACHE_LINE_SIZE - 1;
+    if (n > (~(uint)0 - extra) / sizeof(PaddedChannel))
+        return NULL;
+    uint size = n * sizeof(PaddedChannel) + extra;
+    int index = try_find_mem_index(size);
+    if (index < 0)
+        return NULL;
+    byte *block = try_allocate_mem(index);
+    if (block == NULL)
+        return NULL;
+
+    // find first line boundary that leaves room for the header
+    Addr start = ((Addr)block + sizeof(ChannelArrayHeader) 
+                    + CACHE_LINE_SIZE - 1) & ~(Addr)(CACHE_LINE_SIZE - 1);
+    PaddedChannel *chans = (PaddedChannel *)start;
+
+    // remember the block so the array can be released
+    ChannelArrayHeader *hdr = (ChannelArrayHeader *)start - 1;
+    hdr->block = block;
+    hdr->index = index;
+
+    init_channel_array(chans, n);
+    return chans;
+}
+
+/** Releases an array obtained from allocate_channels */
+void release_channels(PaddedChannel *chans)
+{
+    ChannelArrayHeader *hdr = (ChannelArrayHeader *)chans - 1;
+    release_mem(hdr->index, hdr->block);
+}
+
+/** Takes the data offered by the writer waiting on channel and frees
+ *  the writer.  Caller must hold the channel's mutex; it is released. */
+static void take_offer(Channel *chan, Word *paramDest, uint len)
+{
+    memcpy(paramDest, chan->src, len); 
+    Process *wasWaiting = chan->waiting;
+    chan->waiting = NULL;
+    chan->src = NULL;
+    release_mutex(&chan->mutex);   // release exclusive access
+
+    // make the sending process ready
+    int old_state = atomic_exchange_explicit(
+        &wasWaiting->sched_state, PROC_READY, memory_order_acq_rel);
+
+    // if sending process was waiting, schedule it
+    if (old_state == PROC_WAITING) {
+        schedule(wasWaiting);
+    }
+}
+
+/** Gives data to the reader waiting on channel and frees the reader.
+ *  Caller must hold the channel's mutex; it is released. */
+static void give_to_reader(Channel *chan, Word *paramSrc, uint len)
+{
+    memcpy(chan->dest, paramSrc, len);
+    Process *wasWaiting = chan->waiting; 
+    chan->waiting = NULL;
+    chan->dest = NULL;
+    release_mutex(&chan->mutex);  // release exclusive access
+
+    // make the receiving process ready
+    int old_state = atomic_exchange_explicit(
+        &wasWaiting->sched_state, PROC_READY, memory_order_acq_rel);
+
+    // if receiving process was waiting, schedule it
+    if (old_state == PROC_WAITING) {
+        schedule(wasWaiting);
+    }
+}
+
+/** 
+ *  Ends a wait bounded by a deadline (see in_until and out_until).
+ *  If the process is still waiting on the channel, the deadline 
+ *  passed first, and the process withdraws -- unless the other side
+ *  has claimed it (an alternation found the channel ready, or 
+ *  extended input took the data in place), in which case it waits
+ *  on until either the transfer is done or the claim is released
+ *  (see unclaim_channel).  Returns true if the transfer completed.
+ */
+static _Bool end_wait_until(Channel *chan, Process *curr)
+{
+    claim_mutex(&chan->mutex);   // claim exclusive access to this channel
+    while (chan->waiting == curr) 
+    {
+        if (!chan->claimed) {
+            // withdraw
+            chan->waiting = NULL;
+            chan->src = NULL;
+            chan->expired = false;
+            release_mutex(&chan->mutex);   // release exclusive access
+            return false;
+        }
+        // other side is committed: wait for it
+        chan->expired = true;
+        PREPARE_TO_WAIT(curr);
+        release_mutex(&chan->mutex);   // release exclusive access
+        relinquish();
+        claim_mutex(&chan->mutex);     // claim exclusive access
+    }
+    // transfer done
+    release_mutex(&chan->mutex);   // release exclusive access
+    return true;
+}
+
+/** 
+ *  Releases the claim an alternation made on a ready channel that
+ *  it did not select.  If the waiting process's deadline has passed
+ *  while the claim held it, it is freed to withdraw.
+ */
+void unclaim_channel(Channel *chan)
+{
+    claim_mutex(&chan->mutex);   // claim exclusive access to this channel
+    Process *expired = chan->expired ? chan->waiting : NULL;
+    chan->claimed = false;
+    chan->expired = false;
+    release_mutex(&chan->mutex);   // release exclusive access
+
+    if (expired != NULL) {
+        // make the expired process ready, so it withdraws
+        int old_state = atomic_exchange_explicit(
+            &expired->sched_state, PROC_READY, memory_order_acq_rel);
+        if (old_state == PROC_WAITING) {
+            schedule(expired);
+        }
+    }
 }
 
 /** Reads from channel. */
@@ -36,7 +192,7 @@ void in(Channel *chan, Word *paramDest, uint len)
 {
     Process *curr = get_current();
     claim_mutex(&chan->mutex);   // claim exclusive access to this channel
-    if (chan->waiting != NULL)
+    if (chan->waiting != NULL && !chan->alting)
     {
         Process *wasWaiting;
 
@@ -60,11 +216,20 @@ void in(Channel *chan, Word *paramDest, uint len)
     }
     else
     {
-        // writer not ready, so relinquish processor and wait
+        // writer not ready (or alting on output, in which case
+        // free it to select this channel), so relinquish 
+        // processor and wait
+        Process *wasWaiting = chan->waiting;
         chan->dest = paramDest;
         chan->waiting = curr;
+        chan->alting = false;
+        chan->claimed = false;
+        chan->expired = false;
         PREPARE_TO_WAIT(curr);
         release_mutex(&chan->mutex);   // release exclusiv access
+        if (wasWaiting != NULL) {
+            freeProcessMaybe(wasWaiting);
+        }
         relinquish();
         // when this process resumes, the io is done
         // and the process can continue from this point
@@ -74,32 +239,171 @@ void in(Channel *chan, Word *paramDest, uint len)
 /** Reads from channel and returns true if can do so without waiting. */
 _Bool try_in(Channel *chan, Word *paramDest, uint len)
 {
-    Process * wasWaiting;
     claim_mutex(&chan->mutex);   // claim exclusive access to this channel
-    if (chan->waiting != NULL)
+    if (chan->waiting != NULL && !chan->alting)
     {
         // writer is ready: transfer data and return true
-        memcpy(paramDest, chan->src, len); 
-        wasWaiting = chan->waiting;
-        chan->waiting = NULL;
-        chan->src = NULL;
-        release_mutex(&chan->mutex);   // release exclusive access
+        take_offer(chan, paramDest, len);
         return true;
     }
     else
     {
-        // writer not ready: just return false
+        // writer not ready (or only alting): just return false
         release_mutex(&chan->mutex);   // release exclusive access
         return false;
     }
 }
 
+/** 
+ *  Reads from channel, waiting no later than the given deadline.
+ *  Returns true if the read completed and false if the deadline
+ *  passed first.  A writer alting on output that the read frees to
+ *  select the channel is waited for even after the deadline.
+ */
+_Bool in_until(Channel *chan, Word *paramDest, uint len, Time deadline)
+{
+    // if deadline already past, just try without waiting
+    if (deadline <= GetCurrentTime()) {
+        return try_in(chan, paramDest, len);
+    }
+
+    Process *curr = get_current();
+    claim_mutex(&chan->mutex);   // claim exclusive access to this channel
+    if (chan->waiting != NULL && !chan->alting)
+    {
+        // writer is ready: transfer data
+        take_offer(chan, paramDest, len);
+        return true;
+    }
+
+    // writer not ready (or alting on output, in which case free
+    // it to select this channel; it claims this process only if 
+    // it finds the channel ready), so wait for writer or deadline
+    Process *wasWaiting = chan->waiting;
+    chan->dest = paramDest;
+    chan->waiting = curr;
+    chan->alting = false;
+    chan->claimed = false;
+    chan->expired = false;
+    PREPARE_TO_WAIT(curr);
+    release_mutex(&chan->mutex);   // release exclusive access
+    if (wasWaiting != NULL) {
+        freeProcessMaybe(wasWaiting);
+    }
+    relinquish_until(deadline);
+
+    // if still waiting, deadline passed first
+    return end_wait_until(chan, curr);
+}
+
+/** 
+ *  Begins extended input: waits for the writer and returns a pointer
+ *  to its data in place.  The writer stays blocked until the reader 
+ *  calls in_ext_end, so the data remain valid until then.
+ */
+Word *in_ext_begin(Channel *chan)
+{
+    Process *curr = get_current();
+    claim_mutex(&chan->mutex);   // claim exclusive access to this channel
+    while (chan->waiting == NULL || chan->waiting == curr 
+            || chan->alting)
+    {
+        // writer not ready (or alting on output, in which case
+        // free it to select this channel), so register with no
+        // destination, which makes the writer wait for in_ext_end;
+        // use the alternation protocol, so that the writer
+        // frees this process (see freeProcessMaybe in 'out')
+        Process *wasWaiting = chan->waiting;
+        altEnabling(curr);
+        chan->waiting = curr;
+        chan->dest = NULL;
+        chan->alting = false;
+        chan->claimed = false;
+        chan->expired = false;
+        release_mutex(&chan->mutex);   // release exclusive access
+        if (wasWaiting != NULL && wasWaiting != curr) {
+            freeProcessMaybe(wasWaiting);
+        }
+        if (altShouldWait(curr)) {
+            relinquish_unconditional();
+        }
+        altFinish(curr);
+        // when this process resumes, a writer has come, but one in
+        // out_until may have withdrawn again before this process
+        // could claim it, in which case wait for another
+        claim_mutex(&chan->mutex);   // claim exclusive access
+    }
+
+    // writer is ready: hold it to its offer (so out_until cannot
+    // withdraw it), and hand over its data
+    chan->claimed = true;
+    Word *src = chan->src;
+    release_mutex(&chan->mutex);   // release exclusive access
+    return src;
+}
+
+/** Ends extended input, freeing the writer */
+void in_ext_end(Channel *chan)
+{
+    claim_mutex(&chan->mutex);   // claim exclusive access to this channel
+    Process *wasWaiting = chan->waiting;
+    if (wasWaiting == NULL || chan->alting) {
+        plotz("in_ext_end without writer");
+    }
+    chan->waiting = NULL;
+    chan->src = NULL;
+    release_mutex(&chan->mutex);   // release exclusive access
+
+    // make the sending process ready
+    int old_state = atomic_exchange_explicit(
+        &wasWaiting->sched_state, PROC_READY, memory_order_acq_rel);
+
+    // if sending process was waiting, schedule it
+    if (old_state == PROC_WAITING) {
+        schedule(wasWaiting);
+    }
+}
+
+/** Initializes given call channel */
+void init_call_channel(CallChannel *cchan)
+{
+    init_channel(&cchan->chan);
+}
+
+/** 
+ *  Calls server, waiting until it replies.
+ *  A call is an output of the client's call record that the 
+ *  server takes by extended input.
+ */
+void call(CallChannel *cchan, Word *req, uint reqlen, Word *rep, uint replen)
+{
+    Call c;
+    c.req = req;
+    c.reqlen = reqlen;
+    c.rep = rep;
+    c.replen = replen;
+    out(&cchan->chan, (Word *)&c, sizeof(c));
+    // when this process resumes, the server has replied
+}
+
+/** Accepts a call, returning the client's call record */
+Call *accept_call(CallChannel *cchan)
+{
+    return (Call *)in_ext_begin(&cchan->chan);
+}
+
+/** Completes the accepted call, releasing the client */
+void reply_call(CallChannel *cchan)
+{
+    in_ext_end(&cchan->chan);
+}
+
 /** Returns true if read would complete. */
 _Bool chan_pending(Channel *chan)
 {
     // pending if writer is waiting
     claim_mutex(&chan->mutex);     // claim exclusive access to this channel
-    _Bool pending = (chan->waiting != NULL && chan->src != NULL);
+    _Bool pending = (chan->waiting != NULL && !chan->alting);
     release_mutex(&chan->mutex);   // release exclusive access
     return pending;
 }
@@ -139,6 +443,9 @@ void out(Channel *chan, Word *paramSrc, uint len)
             // receiver to complete the io
             wasWaiting = chan->waiting;
             chan->waiting = curr;
+            chan->alting = false;
+            chan->claimed = true;
+            chan->expired = false;
             PREPARE_TO_WAIT(curr);
             chan->src = paramSrc;
             release_mutex(&chan->mutex);  // release exclusive access
@@ -153,8 +460,16 @@ void out(Channel *chan, Word *paramSrc, uint len)
         // receiver not ready, so relinquish processor and wait
         chan->src = paramSrc;
         chan->waiting = curr;
+        chan->alting = false;
+        chan->claimed = false;
+        chan->expired = false;
         PREPARE_TO_WAIT(curr);
+        PGuard *pguard = chan->pguard;
         release_mutex(&chan->mutex);      // release exclusive access
+        if (pguard != NULL) {
+            // tell the persistent alternation the channel is ready
+            pguard_ready(pguard);
+        }
         relinquish();
         // when this process resumes, the io is done
         // and the process can continue from this point
@@ -162,6 +477,73 @@ void out(Channel *chan, Word *paramSrc, uint len)
 }
 
 
+/** Writes to channel and returns true if can do so without waiting. */
+_Bool try_out(Channel *chan, Word *paramSrc, uint len)
+{
+    claim_mutex(&chan->mutex);   // claim exclusive access to this channel
+    if (chan->waiting != NULL && chan->dest != NULL)
+    {
+        // reader is waiting in 'in': transfer the data
+        give_to_reader(chan, paramSrc, len);
+        return true;
+    }
+    else
+    {
+        // reader not ready, or alting (and so not yet committed
+        // to the read): just return false
+        release_mutex(&chan->mutex);   // release exclusive access
+        return false;
+    }
+}
+
+/** 
+ *  Writes to channel, waiting no later than the given deadline.
+ *  Returns true if the write completed and false if the deadline
+ *  passed first.  A reader that has committed to the offer (an 
+ *  alternation that has selected the channel, or extended input)
+ *  is waited for even after the deadline.
+ */
+_Bool out_until(Channel *chan, Word *paramSrc, uint len, Time deadline)
+{
+    // if deadline already past, just try without waiting
+    if (deadline <= GetCurrentTime()) {
+        return try_out(chan, paramSrc, len);
+    }
+
+    Process *curr = get_current();
+    claim_mutex(&chan->mutex);  // claim exclusive access to this channel
+    if (chan->waiting != NULL && chan->dest != NULL)
+    {
+        // reader is waiting in 'in': transfer the data
+        give_to_reader(chan, paramSrc, len);
+        return true;
+    }
+
+    // reader alting (in which case free it to select this 
+    // channel; it claims this process only if it finds the 
+    // channel ready, and extended input only once it takes the
+    // data) or not ready, so offer the data and wait for reader
+    // or deadline
+    Process *wasWaiting = chan->waiting;
+    chan->waiting = curr;
+    chan->src = paramSrc;
+    chan->alting = false;
+    chan->claimed = false;
+    chan->expired = false;
+    PREPARE_TO_WAIT(curr);
+    PGuard *pguard = chan->pguard;
+    release_mutex(&chan->mutex);  // release exclusive access
+    if (wasWaiting != NULL) {
+        freeProcessMaybe(wasWaiting);
+    } else if (pguard != NULL) {
+        pguard_ready(pguard);
+    }
+    relinquish_until(deadline);
+
+    // if still waiting, deadline passed first
+    return end_wait_until(chan, curr);
+}
+
 /** 
  *  Enables channel for alt, returns true if channel ready. 
  *  input:  chan    the channel
@@ -177,8 +559,15 @@ _Bool enable_channel(Channel *chan, Process *proc)
             // the waiting process is us waiting to read
             release_mutex(&chan->mutex);   // release exclusive access
             return false;
+        } else if (chan->alting) {
+            // writer is only alting on output: one alternation
+            // cannot wait for another
+            release_mutex(&chan->mutex);   // release exclusive access
+            plotz("Alternation at both ends of channel");
+            return false;
         } else {
-            // writer is ready
+            // writer is ready: hold it to its offer
+            chan->claimed = true;
             release_mutex(&chan->mutex);   // release exclusive access
             return true;
         }
@@ -186,6 +575,81 @@ _Bool enable_channel(Channel *chan, Process *proc)
         // put proc into channel 
         chan->waiting = proc;
         chan->dest = NULL;
+        chan->alting = true;
+        chan->claimed = false;
+        chan->expired = false;
+        release_mutex(&chan->mutex);       // release exclusive access
+        return false;
+    }
+}
+
+/** 
+ *  Enables channel for output in alt, returns true if reader ready. 
+ *  input:  chan    the channel
+ *          proc    the alting (writing) process
+ *  output: true if reader waiting on channel
+ */
+_Bool enable_output(Channel *chan, Process *proc)
+{
+    claim_mutex(&chan->mutex);     // claim exclusive access to this channel 
+    if (chan->waiting != NULL) {
+        if (chan->waiting == proc) {
+            // channel appears multiple times in alt
+            release_mutex(&chan->mutex);   // release exclusive access
+            return false;
+        } else if (chan->alting) {
+            // reader is only alting: one alternation
+            // cannot wait for another
+            release_mutex(&chan->mutex);   // release exclusive access
+            plotz("Alternation at both ends of channel");
+            return false;
+        } else {
+            // reader is ready (if in extended input, the output
+            // waits until in_ext_end): hold it to its read
+            chan->claimed = true;
+            release_mutex(&chan->mutex);   // release exclusive access
+            return true;
+        }
+    } else if (chan->pguard != NULL) {
+        // reader is a persistent alternation or channel group,
+        // which waits for data on offer
+        release_mutex(&chan->mutex);       // release exclusive access
+        plotz("Alternation at both ends of channel");
+        return false;
+    } else {
+        // put proc into channel, marked alting, so 
+        // the reader knows it is not offering data
+        chan->waiting = proc;
+        chan->src = NULL;
+        chan->alting = true;
+        chan->claimed = false;
+        chan->expired = false;
+        release_mutex(&chan->mutex);       // release exclusive access
+        return false;
+    }
+}
+
+/** 
+ *  Disables channel for output in alt, returns true if reader ready. 
+ *  input:  chan    the channel
+ *          proc    the alting (writing) process
+ *  output: true if reader waiting on channel
+ */
+_Bool disable_output(Channel *chan, Process *proc)
+{
+    claim_mutex(&chan->mutex);     // claim exclusive access to this channel 
+    if (chan->waiting != NULL && chan->waiting != proc) {
+        // reader ready for channel (enable_output refuses an
+        // alting reader): the alternation may select the 
+        // channel, so the reader must not withdraw
+        chan->claimed = true;
+        release_mutex(&chan->mutex);       // release exclusive access
+        return true;
+    } else {
+        // either no one waiting or just us again
+        if (chan->waiting == proc) {
+            chan->waiting = NULL;
+        }
         release_mutex(&chan->mutex);       // release exclusive access
         return false;
     }
@@ -200,13 +664,17 @@ _Bool enable_channel(Channel *chan, Process *proc)
 _Bool disable_channel(Channel *chan, Process *proc)
 {
     claim_mutex(&chan->mutex);     // claim exclusive access to this channel 
-    if (chan->waiting != NULL && chan->waiting != proc) {
-        // writer ready for channel
+    if (chan->waiting != NULL && chan->waiting != proc && !chan->alting) {
+        // writer ready for channel: the alternation may select 
+        // the channel, so the writer must not withdraw
+        chan->claimed = true;
         release_mutex(&chan->mutex);       // release exclusive access
         return true;
     } else {
         // either no one waiting or just us again
-        chan->waiting = NULL;
+        if (chan->waiting == proc) {
+            chan->waiting = NULL;
+        }
         release_mutex(&chan->mutex);       // release exclusive access
         return false;
     }
@@ -23,6 +23,9 @@
 #include "types.h"
 #include "mutex.h"
 
+// forward declaration (see alt.h)
+typedef struct PGuard PGuard;
+
 typedef struct Channel {  
 
     Mutex mutex;
@@ -32,21 +35,87 @@ typedef struct Channel {
         Word *dest;
     };
     uint len;
+    PGuard *pguard;       // registration in persistent alternation, if any
+    _Bool alting;         // waiting process is alting, not committed
+    _Bool claimed;        // other side committed to waiting process
+    _Bool expired;        // waiting process past its deadline, held by claim
 
 } Channel;
 
+/** Channel padded out to a cache line of its own, so that channels
+ *  declared side by side but used on different processing units do
+ *  not falsely share a line.  Use &padded.chan wherever a Channel * 
+ *  is wanted. */
+typedef struct PaddedChannel {
+    Channel chan;
+} CACHE_ALIGNED PaddedChannel;
+
+/** Call channel: carries a client's request to a server and the
+ *  server's reply back in a single rendezvous.  The server works 
+ *  directly on the client's buffers. */
+typedef struct CallChannel {
+    Channel chan;       // carries the client's Call record
+} CallChannel;
+
+/** A client's call, as seen by the server */
+typedef struct Call {
+    Word *req;          // client's request
+    uint reqlen;        // length of request
+    Word *rep;          // client's buffer for reply
+    uint replen;        // length of reply buffer
+} Call;
+
 /** Reads from channel */
 void in(Channel *chan, Word *paramDest, uint len);
 
 /** Initializes given channel */
 void init_channel(Channel *chan);
 
+/** Initializes given array of padded channels */
+void init_channel_array(PaddedChannel *chans, uint n);
+
+/** Allocates and initializes a cache-aligned array of padded channels,
+ *  returning NULL if the array cannot be allocated.  The channels are
+ *  not contiguous, so the array cannot be given to init_channel_group
+ *  (which wants a plain Channel array). */
+PaddedChannel *allocate_channels(uint n);
+
+/** Releases an array obtained from allocate_channels */
+void release_channels(PaddedChannel *chans);
+
 /** Writes to channel */
 void out(Channel *chan, Word *paramSrc, uint len);
 
+/** Begins extended input, returning pointer to writer's data */
+Word *in_ext_begin(Channel *chan);
+
+/** Ends extended input, releasing writer */
+void in_ext_end(Channel *chan);
+
+/** Initializes given call channel */
+void init_call_channel(CallChannel *cchan);
+
+/** Calls server, waiting until it replies */
+void call(CallChannel *cchan, Word *req, uint reqlen, Word *rep, uint replen);
+
+/** Accepts a call, returning the client's call record */
+Call *accept_call(CallChannel *cchan);
+
+/** Completes the accepted call, releasing the client */
+void reply_call(CallChannel *cchan);
+
 /** Reads from channel and returns true if can do so without waiting */
 _Bool try_in(Channel *chan, Word *paramSrc, uint len);
 
+/** Writes to channel and returns true if can do so without waiting */
+_Bool try_out(Channel *chan, Word *paramSrc, uint len);
+
+/** Reads from channel, returning false if deadline passes first */
+_Bool in_until(Channel *chan, Word *paramDest, uint len, Time deadline);
+
+/** Writes to channel, returning false if deadline passes first */
+_Bool out_until(Channel *chan, Word *paramSrc, uint len, Time deadline);
+
 /** Returns True if read would complete */
 //_Bool chan_pending(Channel *chan);
 
@@ -56,5 +125,15 @@ _Bool enable_channel(Channel *chan, Process *proc);
 /** Disables channel for alt, returns True if channel ready. */
 _Bool disable_channel(Channel *chan, Process *proc);
 
+/** Enables channel for output in alt, returns True if reader ready. */
+_Bool enable_output(Channel *chan, Process *proc);
+
+/** Disables channel for output in alt, returns True if reader ready. */
+_Bool disable_output(Channel *chan, Process *proc);
+
+/** Releases the claim an alternation made on a ready channel that
+ *  it did not select, so the waiting process may withdraw again */
+void unclaim_channel(Channel *chan);
+
 
 #endif
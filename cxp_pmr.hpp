@@ -0,0 +1,180 @@
+
+/**
+ *  CXP   C eXecutive Program
+ *  Copyright (c) 2014 Michael E. Goldsby
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CXP_PMR_HPP
+#define CXP_PMR_HPP
+
+/*---------------------------------------------------------------------
+ |  Lets C++ code in CXP processes allocate from the executive's 
+ |  allocator (memory.c) rather than the global heap: a 
+ |  std::pmr::memory_resource for pmr containers and an allocator
+ |  template for the classic ones.  Blocks come from the allocating 
+ |  unit's cache of free blocks of the right size, so most 
+ |  allocations and deallocations claim no lock.  Use only in 
+ |  processes, after initialize.
+ |
+ |  Header only.  The C headers cannot be included here (they use
+ |  C11 atomics), so the few allocator entry points are declared
+ |  directly below; they must match memory.h.
+ *--------------------------------------------------------------------*/
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <new>
+
+extern "C" {
+int find_mem_index(unsigned int size);
+int try_find_mem_index(unsigned int size);
+unsigned char *try_allocate_mem(uint16_t index);
+void release_mem(uint16_t index, unsigned char *addr);
+}
+
+namespace cxp {
+
+namespace detail {
+
+/** True if 'alignment' is stricter than every block is aligned to
+ *  (MEM_ALIGN in memory.h, the alignment of std::max_align_t) */
+inline bool over_aligned(std::size_t alignment)
+{
+    return alignment > alignof(std::max_align_t);
+}
+
+/** Length of block that holds 'bytes' aligned to 'alignment'.  An
+ *  ordinary request takes the block as it is; an over-aligned one 
+ *  needs room to align it, with the address of the block itself 
+ *  stored just below the result. */
+inline std::size_t block_len(std::size_t bytes, std::size_t alignment)
+{
+    if (!over_aligned(alignment)) {
+        return bytes;
+    }
+    return bytes + sizeof(void *) + alignment - 1;
+}
+
+/** Allocates 'bytes' aligned to 'alignment' */
+inline void *allocate(std::size_t bytes, std::size_t alignment)
+{
+    std::size_t len = block_len(bytes, alignment);
+    if (len < bytes || len > UINT32_MAX) {
+        throw std::bad_alloc();
+    }
+    // a request too large for any block is exhaustion too
+    int index = try_find_mem_index(static_cast<unsigned int>(len));
+    if (index < 0) {
+        throw std::bad_alloc();
+    }
+    unsigned char *block = try_allocate_mem(static_cast<uint16_t>(index));
+    if (block == nullptr) {
+        throw std::bad_alloc();
+    }
+    if (!over_aligned(alignment)) {
+        return block;
+    }
+    std::uintptr_t p = reinterpret_cast<std::uintptr_t>(block) + sizeof(void *);
+    p = (p + alignment - 1) & ~static_cast<std::uintptr_t>(alignment - 1);
+    void *mem = reinterpret_cast<void *>(p);
+    std::memcpy(static_cast<unsigned char *>(mem) - sizeof(void *),
+                &block, sizeof(void *));
+    return mem;
+}
+
+/** Deallocates memory from allocate(bytes, alignment) */
+inline void deallocate(void *mem, std::size_t bytes, std::size_t alignment)
+{
+    unsigned char *block = static_cast<unsigned char *>(mem);
+    if (over_aligned(alignment)) {
+        std::memcpy(&block, block - sizeof(void *), sizeof(void *));
+    }
+    int index = find_mem_index(
+        static_cast<unsigned int>(block_len(bytes, alignment)));
+    release_mem(static_cast<uint16_t>(index), block);
+}
+
+} // namespace detail
+
+/** Memory resource backed by the CXP allocator */
+class MemoryResource : public std::pmr::memory_resource {
+protected:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        return detail::allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, 
+                       std::size_t alignment) override
+    {
+        detail::deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) 
+        const noexcept override
+    {
+        // all instances draw on the same allocator
+        return dynamic_cast<const MemoryResource *>(&other) != nullptr;
+    }
+};
+
+/** Returns the shared CXP memory resource */
+inline MemoryResource *memory_resource()
+{
+    static MemoryResource resource;
+    return &resource;
+}
+
+/** Allocator for standard containers, backed by the CXP allocator */
+template <class T>
+struct Allocator {
+    using value_type = T;
+
+    Allocator() noexcept {}
+
+    template <class U>
+    Allocator(const Allocator<U> &) noexcept {}
+
+    T *allocate(std::size_t n)
+    {
+        if (n > SIZE_MAX / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T *>(detail::allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept
+    {
+        detail::deallocate(p, n * sizeof(T), alignof(T));
+    }
+};
+
+template <class T, class U>
+bool operator==(const Allocator<T> &, const Allocator<U> &) noexcept
+{
+    return true;
+}
+
+template <class T, class U>
+bool operator!=(const Allocator<T> &, const Allocator<U> &) noexcept
+{
+    return false;
+}
+
+} // namespace cxp
+
+#endif
@@ -0,0 +1,65 @@
+
+// alternation over an interrupt and a timeout
+
+#include "alt.h"
+#include "hardware.h"
+#include "interrupt.h"
+#include "sched.h"
+#include "timer.h"
+#include "types.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+#define ONESEC  1000000000LLU
+
+static void child1()
+{
+    printf("child1\n");
+    Guard guards[2];
+    init_interrupt_guard(&guards[0], get_interrupt(0));
+
+    Alternation alt;
+    init_alt(&alt, guards, 2);
+
+    while (true) {
+        init_timer_guard(&guards[1], Now() + ONESEC/2);
+        int selection = priSelect(&alt);
+        switch (selection) {
+        case 0:
+            printf("Received USER0\n");
+            break;
+        case 1:
+            printf("Timed out at time %llu\n", Now());
+            break;
+        default:
+            printf("Invalid selection %d\n", selection);
+            break;
+        }
+    }
+}
+
+static void child2()
+{
+    printf("child2\n");
+    while (true) {
+        After(Now() + (2*ONESEC));
+        printf("About to send interrupt\n");
+        send_interrupt(INTR_USER0);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    printf("altintr: alternation over interrupt and timeout\n");
+    initialize(0x40000000, 8192);    // 1 GB total allocatable memory
+
+    code_p children[] = { child1, child2 };
+    void *args[] = { NULL, NULL };
+    uint stacksize[] = { 3000, 3000 };
+
+    par(children, args, stacksize, 2);
+    printf("After par\n");
+
+    return 0;
+}
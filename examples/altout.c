@@ -0,0 +1,65 @@
+
+// Tests output guards: dispatcher sends to whichever worker is ready
+
+#include "alt.h"
+#include "comm.h"
+#include "run.h"
+#include "sched.h"
+#include "timer.h"
+#include "types.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+#define ONESEC  1000000000LLU
+
+static Channel work[2];
+
+static void dispatcher()
+{
+    printf("dispatcher\n");
+    Guard guards[2];
+    init_output_guard(&guards[0], &work[0]);
+    init_output_guard(&guards[1], &work[1]);
+
+    Alternation alt;
+    init_alt(&alt, guards, 2);
+
+    int job = 0;
+    while (true) {
+        int selection = fairSelect(&alt);
+        out(&work[selection], &job, sizeof(job));
+        printf("Dispatched job %d to worker %d\n", job, selection);
+        job += 1;
+    }
+}
+
+static void worker(void *arg)
+{
+    int nr = (int)arg;
+    printf("worker %d\n", nr);
+    while (true) {
+        int job;
+        in(&work[nr], &job, sizeof(job));
+        printf("Worker %d doing job %d\n", nr, job);
+        After(Now() + (nr + 1) * ONESEC);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    printf("altout: dispatch to whichever worker is ready\n");
+    initialize(0x40000000, 8192);    // 1 GB total allocatable memory
+
+    init_channel(&work[0]);
+    init_channel(&work[1]);
+
+    code_p children[] = { dispatcher, worker, worker };
+    void *args[] = { NULL, (void *)0, (void *)1 };
+    uint stacksize[] = { 2000, 2000, 2000 };
+
+    par(children, args, stacksize, 3);
+    printf("After par\n");
+
+    return 0;
+}
@@ -0,0 +1,63 @@
+
+
+// Tests call channels with a server alternating over two clients
+
+#include "alt.h"
+#include "comm.h"
+#include "run.h"
+#include "sched.h"
+#include "types.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+static CallChannel cchan[2];
+
+static void server()
+{
+    printf("server\n");
+    Guard guards[2];
+    init_call_guard(&guards[0], &cchan[0]);
+    init_call_guard(&guards[1], &cchan[1]);
+
+    Alternation alt;
+    init_alt(&alt, guards, 2);
+
+    while (true) {
+        int selection = fairSelect(&alt);
+        Call *c = accept_call(&cchan[selection]);
+        int x = *(int *)c->req;
+        *(int *)c->rep = x * x;
+        reply_call(&cchan[selection]);
+    }
+}
+
+static void client(void *arg)
+{
+    int nr = (int)arg;
+    printf("client %d\n", nr);
+    int x;
+    for (x = 0; x < 5; x++) {
+        int y;
+        call(&cchan[nr], &x, sizeof(x), &y, sizeof(y));
+        printf("Client %d: %d squared is %d\n", nr, x, y);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    printf("call: clients call a server over call channels\n");
+    initialize(0x40000000, 8192);    // 1 GB total allocatable memory
+
+    init_call_channel(&cchan[0]);
+    init_call_channel(&cchan[1]);
+
+    code_p children[] = { server, client, client };
+    void *args[] = { NULL, (void *)0, (void *)1 };
+    uint stacksize[] = { 2000, 2000, 2000 };
+
+    par(children, args, stacksize, 3);
+    printf("After par\n");
+
+    return 0;
+}
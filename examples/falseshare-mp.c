@@ -0,0 +1,71 @@
+
+
+// Interprocessor communication on adjacent vs. padded channels
+
+#include "comm.h"
+#include "run.h"
+#include "sched.h"
+#include "timer.h"
+#include "types.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+// comment this out to use plain, adjacent channels
+#define PADDED
+
+#ifdef PADDED
+static PaddedChannel chans[2];
+#define CHAN(i)  (&chans[i].chan)
+#else
+static Channel chans[2];
+#define CHAN(i)  (&chans[i])
+#endif
+
+static void reader(void *arg)
+{
+    Channel *input = (Channel *)arg;
+    Time t0 = GetCurrentTime();
+    int x;
+    while (true) {
+        in(input, &x, sizeof(int));
+        if (x % 100000 == 0) {
+            Time t = GetCurrentTime();
+            double per = (double)(t - t0) / x;
+            printf("x = %d, %g nsec per communication\n", x, per);
+        }
+    }
+}
+
+static void writer(void *arg)
+{
+    Channel *output = (Channel *)arg;
+    int x = 0;
+    while (true) {
+        x += 1;
+        out(output, &x, sizeof(int));
+    }
+}
+
+int main(int argc, char **argv)
+{
+#ifdef PADDED
+    printf("falseshare_mp: two independent pairs on padded channels\n");
+#else
+    printf("falseshare_mp: two independent pairs on adjacent channels\n");
+#endif
+    initialize(0x40000000, 8192);    // 1 GB total allocatable memory
+
+    init_channel(CHAN(0));
+    init_channel(CHAN(1));
+
+    // each unit writes one channel and reads the other
+    code_p children[] = { writer, reader, writer, reader };
+    void *args[] = { CHAN(0), CHAN(0), CHAN(1), CHAN(1) };
+    uint stacksize[] = { 3000, 4000, 3000, 4000 };
+    uint16 place[] = { 0, 1, 1, 0 };
+
+    placed_par(children, args, stacksize, place, 4);
+    printf("After par\n");
+    return 0;
+}
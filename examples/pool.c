@@ -0,0 +1,62 @@
+
+
+// Passes pooled buffers from a process on one unit to a process on another
+
+#include "comm.h"
+#include "pool.h"
+#include "run.h"
+#include "sched.h"
+#include "types.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct Message {
+    int seq;
+    char text[200];
+} Message;
+
+static Pool pool;
+static Channel chan;
+
+static void producer()
+{
+    int i;
+    for (i = 0; i < 10; i++) {
+        Message *msg = pool_get_typed(&pool, Message);
+        msg->seq = i;
+        sprintf(msg->text, "message %d", i);
+        out(&chan, (Word *)&msg, sizeof(msg));
+    }
+}
+
+static void consumer()
+{
+    int i;
+    for (i = 0; i < 10; i++) {
+        Message *msg;
+        in(&chan, (Word *)&msg, sizeof(msg));
+        printf("Received %d: %s\n", msg->seq, msg->text);
+        // return buffer to pool (memory goes home to the producer's unit)
+        pool_put(&pool, msg);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    printf("pool: buffers from a pool travel between units\n");
+    initialize(0x40000000, 8192);    // 1 GB total allocatable memory
+
+    init_typed_pool(&pool, Message);
+    init_channel(&chan);
+
+    code_p children[] = { producer, consumer };
+    void *args[] = { NULL, NULL };
+    uint stacksize[] = { 4000, 4000 };
+    uint16 place[] = { 0, 1 };
+
+    placed_par(children, args, stacksize, place, 2);
+    printf("After par\n");
+    return 0;
+}
@@ -18,18 +18,25 @@
 
 #include "hardware.h"
 #include "timer.h"
+#include <dirent.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <time.h>
 #include <ucontext.h>
+#include <unistd.h>
 #include "dbg.h"
 
 #define NS_PER_SEC  1000000000
 
+// fills unused stack (see STACK_CHECK)
+#define STACK_PAINT  0xdeadbeef
+
 // thread-local key for cpu number
 static pthread_key_t cpu_key;
 
@@ -181,10 +188,41 @@ void build_context(
     if 
     (getcontext(context)) plotz("build_context getcontext");
 
+    // stack proper runs from just above the context record to the
+    // end of the space allocated for it
+    byte *base = (byte *)proc->stackptr + sizeof(ucontext_t);
+    byte *top = (byte *)proc->stack + stacksize + STACK_EXTRA;
+
+#ifdef STACK_GUARD
+    // put a guard page (on a page boundary) between the context 
+    // record and the stack proper
+    // (the initial process, with no code, has its stack elsewhere)
+    if (code != NULL) {
+        byte *guard = (byte *)(((Addr)base + GUARD_PAGE_SIZE - 1)
+                                   & ~(Addr)(GUARD_PAGE_SIZE - 1));
+        if
+        (mprotect(guard, GUARD_PAGE_SIZE, PROT_NONE)) plotz("build_context mprotect");
+        base = guard + GUARD_PAGE_SIZE;
+    }
+#endif
+
+#if defined(STACK_CHECK) || defined(STACK_GUARD)
+    proc->stackbase = base;
+    proc->stacklen = (code != NULL) ? top - base : 0;
+#endif
+
+#ifdef STACK_CHECK
+    // paint the stack, so its high-water mark can be found
+    Word *w;
+    for (w = (Word *)base; w < (Word *)top; w++) {
+        *w = STACK_PAINT;
+    }
+#endif
+
     // set stack descriptors
     context->uc_link = NULL;
-    context->uc_stack.ss_sp = (char *)proc->stackptr + sizeof(ucontext_t);
-    context->uc_stack.ss_size = stacksize - sizeof(ucontext_t);
+    context->uc_stack.ss_sp = base;
+    context->uc_stack.ss_size = top - base;
 
     // note context->uc_link is irrelevant since no process (except initial
     // process) ever exits (see run_in_par in run.c and idle process)
@@ -193,6 +231,49 @@ void build_context(
     makecontext(context, code, 3, arg1, arg2, userArgs);
 }
 
+/** Undoes anything build_context did to the memory of a process
+ *  record, before the record is released */
+void release_context(Process *proc)
+{
+#ifdef STACK_GUARD
+    // make guard page accessible again
+    if (proc->stacklen != 0) {
+        if
+        (mprotect(proc->stackbase - GUARD_PAGE_SIZE, GUARD_PAGE_SIZE, 
+                  PROT_READ | PROT_WRITE)) plotz("release_context mprotect");
+    }
+#endif
+}
+
+/** Returns the most stack the process has used so far */
+uint stack_high_water(Process *proc)
+{
+#ifdef STACK_CHECK
+    // the stack grows down, so find the lowest word not 
+    // still holding the paint
+    Word *w = (Word *)proc->stackbase;
+    Word *top = (Word *)(proc->stackbase + proc->stacklen);
+    while (w < top && *w == STACK_PAINT) {
+        w++;
+    }
+    return (byte *)top - (byte *)w;
+#else
+    return 0;
+#endif
+}
+
+/** Prints the process's stack usage */
+void print_stack_usage(Process *proc)
+{
+#ifdef STACK_CHECK
+    if (proc->stacklen == 0) return;
+    uint used = stack_high_water(proc);
+    printf("process %p: used %u of %u bytes of stack%s\n", (void *)proc,
+        used, proc->stacklen, 
+        (used >= proc->stacklen) ? " (overflowed)" : "");
+#endif
+}
+
 /** Restores the context of a process, giving it the processor */
 void restore_context(Process *proc)
 {
@@ -264,14 +345,88 @@ inline int getcpu()
     // store cpu+1 in case value of NULL is zero
 }
 
-/** Returns the address of a region of memory of the specified length */
+// size of a huge page (bytes)
+#define HUGE_PAGE_SIZE  0x200000
+
+// memory policy: prefer given node (see mbind(2))
+#define MPOL_PREFERRED  1
+
+// words in cpu mask (see sched_setaffinity(2))
+#define CPU_MASK_WORDS  16
+
+/** Reserves a region of memory of the specified length */
 char *acquire_memory(int bytes)
 {
-    char *p = malloc(bytes);
-    if (p == NULL) plotz("acquire_memory malloc");
+    // reserve address space only: no memory is committed, 
+    // so neither the time nor the resident size depends on 
+    // the length (the region starts on a page boundary, and 
+    // so on a cache line boundary; see allocate_mem)
+    void *p = MAP_FAILED;
+#ifdef HUGE_PAGES
+    // try reserved huge pages first
+    size_t hugelen = (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    p = mmap(NULL, hugelen, PROT_NONE, 
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_HUGETLB, -1, 0);
+#endif
+    if (p == MAP_FAILED) {
+        p = mmap(NULL, bytes, PROT_NONE, 
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p == MAP_FAILED) plotz("acquire_memory mmap");
+#ifdef HUGE_PAGES
+        // no reserved huge pages, ask for transparent ones
+        madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+    }
     return p;
 }
 
+/** Commits part of the reserved region */
+_Bool commit_memory(char *addr, int bytes)
+{
+    return mprotect(addr, bytes, PROT_READ | PROT_WRITE) == 0;
+}
+
+/** Gives the memory behind part of the region back to the system */
+void discard_memory(char *addr, int bytes)
+{
+    madvise(addr, bytes, MADV_DONTNEED);
+}
+
+#ifdef NUMA
+/** Returns the NUMA node of the cpu on which a processing unit 
+ *  runs, or -1 if not known */
+static int unit_node(int pun)
+{
+    char path[64];
+    int cpu = pun % sysconf(_SC_NPROCESSORS_ONLN);
+    sprintf(path, "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = opendir(path);
+    if (dir == NULL) return -1;
+    int node = -1;
+    struct dirent *entry;
+    while (node < 0 && (entry = readdir(dir)) != NULL) {
+        sscanf(entry->d_name, "node%d", &node);
+    }
+    closedir(dir);
+    return node;
+}
+#endif
+
+/** Places region of memory in memory local to processing unit */
+void place_memory(char *addr, int bytes, int pun)
+{
+#ifdef NUMA
+    // prefer the unit's node; if that fails, the memory 
+    // is simply placed by the system's default policy
+    int node = unit_node(pun);
+    if (node >= 0 && node < 8 * sizeof(unsigned long)) {
+        unsigned long nodemask = 1UL << node;
+        syscall(SYS_mbind, addr, bytes, MPOL_PREFERRED, 
+                &nodemask, 8 * sizeof(nodemask), 0);
+    }
+#endif
+}
+
 /** Synchronize at barrier (all processors synch here) */
 void synchronize_processors() 
 {
@@ -291,6 +446,15 @@ static void init_processor(int cpu)
     (pthread_setspecific(cpu_key, (void *)(cpu+1))) plotz("init_processor setspecific");
     // add one in case the value of NULL is zero (see getcpu)
 
+#ifdef NUMA
+    // run on a cpu of its own, near its memory (see place_memory)
+    unsigned long cpumask[CPU_MASK_WORDS] = { 0 };
+    int target = cpu % sysconf(_SC_NPROCESSORS_ONLN);
+    cpumask[target / (8 * sizeof(long))] = 1UL << (target % (8 * sizeof(long)));
+    if
+    (syscall(SYS_sched_setaffinity, 0, sizeof(cpumask), cpumask)) plotz("init_processor setaffinity");
+#endif
+
     // make an entry in the cpu id --> thread id map for this thread
     thread_id[cpu] = ATOMIC_VAR_INIT(pthread_self());
     // thread_id[cpu] written here during init only by cpu
@@ -61,6 +61,9 @@ void set_stack(Process *proc, byte *stack, uint stacksize, code_p code);
 /** Give processor to a given process. */
 void restore_context(Process *new);
 
+/** Undoes anything build_context did to a process record's memory */
+void release_context(Process *proc);
+
 /** Sets up process to begin executing with the given code and argument */
 void build_context(Process *proc, uint stacksize, code_p code, 
                        void *arg1, void *arg2, void *userArgs);
@@ -68,9 +71,42 @@ void build_context(Process *proc, uint stacksize, code_p code,
 /** Returns the processor number (0..NPUN-1) */
 inline int getcpu();
 
-/** Returns the address of a region of memory of the specified length */
+// Define HUGE_PAGES to back allocatable memory with huge pages 
+// (reserved ones if there are any, otherwise transparent ones), 
+// which cuts TLB misses when the region is large.
+//#define HUGE_PAGES
+
+// Define NUMA to pin each processing unit to a cpu of its own and
+// to place the unit's share of allocatable memory on that cpu's
+// NUMA node.
+//#define NUMA
+
+// granularity at which memory can be placed and committed (bytes)
+#ifdef HUGE_PAGES
+#define MEM_PAGE_SIZE  0x200000
+#else
+#define MEM_PAGE_SIZE  4096
+#endif
+
+// memory is committed this much at a time, as it is first needed
+#define MEM_COMMIT_SIZE  (16 * MEM_PAGE_SIZE)
+
+/** Reserves a region of memory of the specified length and returns
+ *  its address.  The region must be committed before it is used. */
 char *acquire_memory(int bytes);
 
+/** Commits part of the region (page aligned), making it usable.
+ *  Returns false if the memory is not available. */
+_Bool commit_memory(char *addr, int bytes);
+
+/** Gives the memory behind part of the region (page aligned) back
+ *  to the system; it reads as zeros when next touched */
+void discard_memory(char *addr, int bytes);
+
+/** Places region of memory (page aligned) in memory local to the
+ *  given processing unit, if the hardware allows */
+void place_memory(char *addr, int bytes, int pun);
+
 /** Halts processor, waiting for an interrupt. */
 void halt_processor();
 
@@ -17,6 +17,7 @@
  */
 
 #include "interrupt.h"
+#include "alt.h"
 #include "hardware.h"
 #include <stdlib.h>
 
@@ -34,6 +35,12 @@
  |  If the process does not complete the two atomic actions
  |  in 'receive' before the interrupt fires, it will miss
  |  the interrupt.
+ |
+ |  A process may also wait for an interrupt in an alternation,
+ |  using an interrupt guard on the Interrupt structure that
+ |  'get_interrupt' returns.  An interrupt that fires while the
+ |  guard is enabled stays pending until the alternation selects
+ |  it, even if another guard is selected first.
  +-----------------------------------------------------------------*/
 
 static Interrupt interrupts[NPUN][NINTR];
@@ -45,7 +52,7 @@ void interrupt_init()
     int pun, intr;
     for (pun = 0; pun < NPUN; pun++) {
         for (intr = 0; intr < NINTR; intr++) {
-            interrupts[pun][intr].waiting = ATOMIC_VAR_INIT(NULL);
+            init_interrupt(&interrupts[pun][intr]);
         }
     }
 }
@@ -53,7 +60,56 @@ void interrupt_init()
 /** Initializes an interrupt structure. */
 void init_interrupt(Interrupt *interrupt) 
 {
-    interrupt->waiting = ATOMIC_VAR_INIT(NULL);
+    atomic_init(&interrupt->waiting, NULL);
+    atomic_init(&interrupt->alting, false);
+    atomic_init(&interrupt->pending, false);
+}
+
+/** Returns this processor's Interrupt structure for the
+ *  given interrupt. */
+Interrupt *get_interrupt(int intr_no)
+{
+    return &interrupts[getcpu()][intr_no];
+}
+
+/** 
+ *  Enables interrupt for alt, returns true if interrupt ready. 
+ *  input:  interrupt   the interrupt (of the alting process's unit)
+ *          proc        the alting process
+ *  output: true if interrupt has fired and not been consumed
+ */
+_Bool enable_interrupt(Interrupt *interrupt, Process *proc)
+{
+    if (atomic_load_explicit(&interrupt->pending, memory_order_acquire)) {
+        return true;
+    }
+    atomic_store_explicit(&interrupt->alting, true, memory_order_relaxed);
+    atomic_store_explicit(&interrupt->waiting, proc, memory_order_release);
+    return false;
+    // (if the interrupt fires from here on, 'transmit' 
+    // sets pending and frees the alting process)
+}
+
+/** 
+ *  Disables interrupt for alt, returns true if interrupt ready. 
+ *  input:  interrupt   the interrupt 
+ *          proc        the alting process
+ *  output: true if interrupt has fired and not been consumed
+ */
+_Bool disable_interrupt(Interrupt *interrupt, Process *proc)
+{
+    // withdraw, unless transmit already has
+    Process *expected = proc;
+    atomic_compare_exchange_strong_explicit(
+        &interrupt->waiting, &expected, NULL,
+        memory_order_acq_rel, memory_order_acquire);
+    return atomic_load_explicit(&interrupt->pending, memory_order_acquire);
+}
+
+/** Consumes interrupt selected by alt. */
+void accept_interrupt(Interrupt *interrupt)
+{
+    atomic_store_explicit(&interrupt->pending, false, memory_order_release);
 }
 
 
@@ -70,6 +126,7 @@ void receive(int intr_no)
     PREPARE_TO_WAIT(curr);
 
     // let it be known that this process is waiting to receive the interrupt
+    atomic_store_explicit(&interrupt->alting, false, memory_order_relaxed);
     atomic_store_explicit(&interrupt->waiting, curr, memory_order_release);
 
     // relinquish the processor
@@ -90,8 +147,16 @@ Process *transmit(int intr_no)
     Process *receiver = (Process *)atomic_exchange_explicit(
                       &interrupt->waiting, NULL, memory_order_acq_rel);
 
-    // if so..
-    if (receiver != NULL) {
+    // if receiver is alting, mark interrupt pending
+    // and free the receiver if it is waiting
+    if (receiver != NULL && 
+            atomic_load_explicit(&interrupt->alting, memory_order_relaxed)) {
+
+        atomic_store_explicit(&interrupt->pending, true, memory_order_release);
+        freeProcessMaybe0(receiver);
+
+    // otherwise, if receiver waiting in 'receive'..
+    } else if (receiver != NULL) {
 
         // set receiving process's state to ready
         int old_state = atomic_exchange_explicit(
@@ -25,12 +25,27 @@
 
 
 typedef struct Interrupt {
-    _Atomic(Process *) waiting;
+    _Atomic(Process *) waiting;   // process waiting for interrupt
+    _Atomic(_Bool) alting;        // waiting process is alting
+    _Atomic(_Bool) pending;       // fired during alt, not yet selected
 } Interrupt;
 
 /** Initializes an Interrupt structure. */
 void init_interrupt(Interrupt *interrupt);
 
+/** Returns this processor's Interrupt structure for the
+ *  given interrupt (for use in an interrupt guard). */
+Interrupt *get_interrupt(int intr_no);
+
+/** Enables interrupt for alt, returns true if interrupt ready. */
+_Bool enable_interrupt(Interrupt *interrupt, Process *proc);
+
+/** Disables interrupt for alt, returns true if interrupt ready. */
+_Bool disable_interrupt(Interrupt *interrupt, Process *proc);
+
+/** Consumes interrupt selected by alt. */
+void accept_interrupt(Interrupt *interrupt);
+
 /** Receiver waits for interrupt. */
 void receive(int intr_no);
 
@@ -66,12 +66,18 @@ static void ipq_init()
     }
 }
 
-/** Add an entry to an interprocessor queue */
-static void ipq_add(int pun, Process *proc)
+/** Add an entry to an interprocessor queue, interrupting the target
+ *  processor only if 'notify' is set (or if the queue fills up with
+ *  entries the target has not been told of) */
+static void ipq_put(int pun, Process *proc, _Bool notify)
 {
     // get queue for given processor
     IPQueue *ipq = &ipQues[pun];
 
+    // (a caller that defers notification must not leave the target
+    // unaware of a full queue, or we would spin forever below)
+    _Bool told = notify;
+
     Atomic_Process_p *a;
     Atomic_Process_p *r;
     Atomic_Process_p *a1;
@@ -85,6 +91,10 @@ ipq_try:
         } else {
             a1 = &ipq->que[0];
         }
+        if (r == a1 && !told) {
+            send_interprocessor_interrupt(pun);
+            told = true;
+        }
     } while (r == a1);
     // queue was nonfull
 
@@ -97,7 +107,9 @@ ipq_try:
         atomic_store_explicit(a, proc, memory_order_release);
 
         // inform the target processor
-        send_interprocessor_interrupt(pun);
+        if (notify) {
+            send_interprocessor_interrupt(pun);
+        }
         // current_pri is now a superfluous variable, unless or until
         // I implement a me-first mutex and revise this logic
         // could this swamp the target processor?
@@ -106,6 +118,12 @@ ipq_try:
     }
 }
 
+/** Add an entry to an interprocessor queue */
+static void ipq_add(int pun, Process *proc)
+{
+    ipq_put(pun, proc, true);
+}
+
 /** Remove the next entry from an interprocessor queue and return it */
 static Process *ipq_remove()
 {
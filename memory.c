@@ -18,80 +18,635 @@
 
 #include "memory.h"
 #include "hardware.h"
+#include "sched.h"
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "dbg.h"
 
-// maximum number of memory allocation sizes
-#define NALLOC  24
+// default length of block for each index, in bytes
+static const uint32 default_lens[] = 
+  { 18, 32, 48, 96, 128, 192, 256, 384, 512, 768, 1024, 1536,
+   2048, 3072, 4096, 6144, 8192, 10240, 12288, 16384, 24576 };
+// an application can supply its own (see initialize_with_sizes)
 
-//blocks that have been allocated and released
-static ChainedBlock_p procmemlist[NALLOC];  
+// length of block for each index, in bytes (zero-terminated)
+static uint32 procmemlen[NALLOC];
 
-// length of block for each index, in bytes
-static uint16 procmemlen[] = 
-  { 18, 32, 48, 96, 128, 192, 256, 384, 512, 768, 1024, 1536,
-   2048, 3072, 4096, 6144, 8192, 10240, 12288, 16384, 24576, 0 };
-// readjust these depending on the application.
+// number of entries in size lookup table
+#define LOOKUP_SIZE  4096
+
+// size lookup table: entry k holds the index of the smallest block 
+// that can hold a request of (k << lookup_shift) + 1 bytes
+static uint8 lookup[LOOKUP_SIZE];
+static int lookup_shift;
+
+/*---------------------------------------------------------------------
+ |  Allocatable memory is divided into one arena per processing unit,
+ |  placed (where the hardware allows) in memory local to the unit.  
+ |  Each arena has its own tail, its own lists of released blocks and
+ |  its own mutex.  A block always goes back to the arena it came 
+ |  from, which is found from its address.  A unit whose arena's tail
+ |  is used up takes blocks from the other arenas.
+ |
+ |  The region is only reserved at the start.  An arena's memory is 
+ |  committed MEM_COMMIT_SIZE bytes at a time as its tail advances, so
+ |  the memory a run uses, not the total it may use, sets its resident
+ |  size.  release_idle_memory gives back the pages of large released
+ |  blocks.  The region and every arena start and end on a page 
+ |  boundary, since memory can be committed only in whole pages.
+ *--------------------------------------------------------------------*/
+
+/** A processing unit's share of allocatable memory */
+typedef struct Arena {
+    Mutex mutex;                         // exclusive access to arena
+    ChainedBlock_p list[NALLOC];         // blocks allocated and released
+    byte *tail;                          // what's left, in one block
+    uint32 taillen;                      // in bytes
+    byte *committed;                     // end of committed memory
+    uint32 len;                          // size of arena, bytes
+    // statistics (see get_mem_stats)
+    uint32 carved[NALLOC];               // blocks taken from tail
+    uint32 allocs[NALLOC];               // allocations not via magazines
+    uint32 releases[NALLOC];             // releases not via magazines
+} CACHE_ALIGNED Arena;
+
+static Arena arena[NPUN];
+
+// whole region of allocatable memory, and the length of each 
+// arena in it (the last arena also takes any remainder)
+static byte *region;
+static uint32 arenalen;
+
+// requests that could not be met
+static _Atomic(uint32) failed;
+
+/*---------------------------------------------------------------------
+ |  Each processing unit also keeps a magazine (a short list of free
+ |  blocks from its own arena) for each size, so that most allocations
+ |  and releases need not claim the arena's mutex.  An empty magazine
+ |  is refilled, and a full one spilled, MAG_BATCH blocks at a time.
+ |  A unit's magazines are guarded by a flag rather than a mutex: a
+ |  process that finds the flag set (another process on the unit was
+ |  preempted while using them) goes to the arena instead.
+ *--------------------------------------------------------------------*/
 
-// what's left, in one big block
-static uint32 taillen;    // in bytes
-static byte *tail;                 
+// most blocks in a magazine
+#define MAG_MAX    8
 
-// used to ensure mutually exclusive access
-static Mutex mutex_mem;
+// blocks moved at once between magazine and arena
+#define MAG_BATCH  (MAG_MAX / 2)
+
+/** Free blocks of one size cached by one unit */
+typedef struct Magazine {
+    ChainedBlock_p blocks;
+    uint16 count;
+    uint32 allocs;         // allocations from this magazine
+    uint32 releases;       // releases to this magazine
+} Magazine;
+
+/** A unit's magazines, on cache lines of their own */
+typedef struct UnitCache {
+    _Atomic(_Bool) busy;       // magazines in use
+    Magazine mag[NALLOC];
+} CACHE_ALIGNED UnitCache;
+
+static UnitCache unitcache[NPUN];
+
+// magazines in use (not until processing units are identified)
+static _Bool caching;
+
+static int large_index(uint size);
+
+/**
+ * Find index of smallest allocation >= given size (bytes), or
+ * return -1 if there is none.
+ * The lookup table gives the answer or one just below it (when
+ * two lengths fall within the same table entry).  A size larger
+ * than every length gets the index of a large block.
+ */
+int try_find_mem_index(uint size)
+{
+    uint k = (size == 0) ? 0 : (size - 1) >> lookup_shift;
+    int i = (k < LOOKUP_SIZE) ? lookup[k] : NALLOC - 1;
+    while (procmemlen[i] && procmemlen[i] < size) {
+        i++;
+    }
+    if (procmemlen[i])
+        return i;
+    i = large_index(size);
+    if (i < 0) {
+        atomic_fetch_add(&failed, 1);
+    }
+    return i;
+}
 
 /**
  * Find index of smallest allocation >= given size (bytes)
  */
 int find_mem_index(uint size)
 {
-    int i;
-    for (i = 0; procmemlen[i]; i++) {
-        if (procmemlen[i] >= size)
-            break;
+    int i = try_find_mem_index(size);
+    if (i < 0) {
+        plotz("No memory block large enough");
     }
-    if (procmemlen[i])
+    return i;
+}
+
+/**
+ * Find index of smallest allocation >= given size (bytes) whose
+ * blocks start on a cache line: a length that is a whole number of
+ * lines (see take_block), or else a large block
+ */
+int find_line_mem_index(uint size)
+{
+    int i = find_mem_index(size);
+    while (i < LARGE_INDEX && procmemlen[i] && 
+           procmemlen[i] % CACHE_LINE_SIZE != 0) {
+        i++;
+    }
+    if (i >= LARGE_INDEX || procmemlen[i])
         return i;
-    else
+    i = large_index(size);
+    if (i < 0) {
+        atomic_fetch_add(&failed, 1);
         plotz("No memory block large enough");
+    }
+    return i;
 }
 
-/** 
- * Allocate block of length implied by index
- * input:   index    1..NALLOC-1
- * output:  array of words of size corresponding to index
+/**
+ * Sets the allocatable lengths and builds the size lookup table
  */
-byte *allocate_mem(uint16 index)
+static void set_lengths(const uint32 lens[], int n)
+{
+    if (n < 1 || n > NALLOC - 1) {
+        plotz("Bad number of memory block sizes");
+    }
+    int i;
+    for (i = 0; i < n; i++) 
+    {
+        // smallest block must hold a timeout descriptor (TMO_INDEX)
+        if (lens[i] < (i == 0 ? default_lens[0] : lens[i-1] + 1)) {
+            plotz("Memory block sizes too small or not ascending");
+        }
+        procmemlen[i] = lens[i];
+    }
+    procmemlen[n] = 0;
+
+    // choose granularity so the table covers the largest length
+    uint32 maxlen = lens[n-1];
+    lookup_shift = 0;
+    while (((maxlen - 1) >> lookup_shift) >= LOOKUP_SIZE) {
+        lookup_shift++;
+    }
+
+    int k;
+    i = 0;
+    for (k = 0; k < LOOKUP_SIZE; k++) {
+        uint32 least = ((uint32)k << lookup_shift) + 1;
+        while (i < n - 1 && procmemlen[i] < least) {
+            i++;
+        }
+        lookup[k] = i;
+    }
+}
+
+/**
+ * Returns the number of the arena a block came from
+ */
+static int home_arena(byte *addr)
+{
+    int pun = (addr - region) / arenalen;
+    return (pun < NPUN) ? pun : NPUN - 1;
+}
+
+/**
+ * Commit arena's memory at least up to the given address, returning
+ * false if the memory is not available
+ */
+static _Bool commit(Arena *a, byte *upto)
+{
+    byte *end = a->tail + a->taillen;
+    byte *target = (byte *)(((Addr)upto + MEM_COMMIT_SIZE - 1)
+                                & ~(Addr)(MEM_COMMIT_SIZE - 1));
+    if (target > end) {
+        target = end;
+    }
+    if (!commit_memory((char *)a->committed, target - a->committed)) {
+        return false;
+    }
+    a->committed = target;
+    return true;
+}
+
+/**
+ * Take block of given length and alignment (a power of two) from the
+ * arena's tail, returning NULL if out of memory.  Caller must hold the
+ * arena's mutex.
+ */
+static byte *carve(Arena *a, uint32 len, uint32 align)
+{
+    uint32 pad = -(Addr)a->tail & (align - 1);
+    if (a->taillen >= pad + len && 
+        (a->tail + pad + len <= a->committed || 
+         commit(a, a->tail + pad + len)))
+    {
+        // tail is big enough, take block from tail
+        byte *block = a->tail + pad;
+        a->tail = a->tail + pad + len;
+        a->taillen -= pad + len;
+        return block;
+    }
+    // out of memory
+    return NULL;
+}
+
+/**
+ * Take block of length implied by index from the arena's list or 
+ * tail, returning NULL if out of memory.  Caller must hold the
+ * arena's mutex.
+ */
+static ChainedBlock_p take_block(Arena *a, uint16 index)
 {
-    claim_mutex(&mutex_mem);                
-    ChainedBlock_p block = procmemlist[index];
+    ChainedBlock_p block = a->list[index];
     if (block != NULL)
     {
         //previously allocated block available, remove it from list
-        procmemlist[index] = block->next;
+        a->list[index] = block->next;
     }
     else 
     {
-        uint16 len = procmemlen[index];
-        if (taillen >= len)
-        {
-            // tail is big enough, take block from tail
-            block = (ChainedBlock_p)tail;
-            tail = tail + len;
+        // start blocks that are whole cache lines on a line boundary,
+        // so that they do not share lines with their neighbors, and
+        // all others on a boundary suitable for any object
+        uint32 len = procmemlen[index];
+        uint32 align = (len % CACHE_LINE_SIZE == 0) ? CACHE_LINE_SIZE 
+                                                    : MEM_ALIGN;
+        block = (ChainedBlock_p)carve(a, len, align);
+        if (block != NULL) {
+            a->carved[index]++;
         }
-        else
-        {
-            // out of memory
-            block = NULL;
-            plotz("Out of memory");
+    }
+    return block;
+}
+
+/**
+ * Take block of length implied by index from the given unit's arena
+ * or, if it is used up, from another, returning NULL if out of memory
+ */
+static ChainedBlock_p take_block_near(int pun, uint16 index)
+{
+    ChainedBlock_p block = NULL;
+    int k;
+    for (k = 0; k < NPUN && block == NULL; k++)
+    {
+        Arena *a = &arena[(pun + k) % NPUN];
+        claim_mutex(&a->mutex);
+        block = take_block(a, index);
+        if (block != NULL) {
+            a->allocs[index]++;
         }
+        release_mutex(&a->mutex);
+    }
+    return block;
+}
+
+/**
+ * Put released block back on its arena's list
+ */
+static void put_block(ChainedBlock_p block, uint16 index)
+{
+    Arena *a = &arena[home_arena((byte *)block)];
+    claim_mutex(&a->mutex);
+    block->next = a->list[index];
+    a->list[index] = block;
+    a->releases[index]++;
+    release_mutex(&a->mutex);
+}
+
+/**
+ * Refill empty magazine from unit's arena: move up to MAG_BATCH 
+ * blocks, taking released blocks from its list first and carving
+ * the rest from its tail
+ */
+static void refill(Magazine *mag, Arena *a, uint16 index)
+{
+    claim_mutex(&a->mutex);
+    while (mag->count < MAG_BATCH) {
+        ChainedBlock_p block = take_block(a, index);
+        if (block == NULL) break;
+        block->next = mag->blocks;
+        mag->blocks = block;
+        mag->count++;
+    }
+    release_mutex(&a->mutex);
+}
+
+/**
+ * Spill full magazine: move MAG_BATCH blocks to unit's arena
+ */
+static void spill(Magazine *mag, Arena *a, uint16 index)
+{
+    // unlink the blocks before claiming the mutex
+    ChainedBlock_p first = mag->blocks;
+    ChainedBlock_p last = first;
+    int i;
+    for (i = 1; i < MAG_BATCH; i++) {
+        last = last->next;
+    }
+    mag->blocks = last->next;
+    mag->count -= MAG_BATCH;
+
+    claim_mutex(&a->mutex);
+    last->next = a->list[index];
+    a->list[index] = first;
+    release_mutex(&a->mutex);
+}
+
+/*---------------------------------------------------------------------
+ |  Requests too large for any size class are met by a buddy allocator
+ |  working in superblocks of BUDDY_MAX bytes, each taken from an 
+ |  arena's tail when the buddy blocks run out.  A released large block
+ |  is merged with its buddy whenever the buddy is also free, so large
+ |  requests of different sizes can share the space over time.  A large
+ |  block's index is LARGE_INDEX plus its order (log2 of its length)
+ |  less BUDDY_MIN_ORDER, so allocate_mem and release_mem handle large
+ |  blocks like any others.
+ *--------------------------------------------------------------------*/
+
+// smallest and largest buddy blocks
+#define BUDDY_MAX        (1 << BUDDY_MAX_ORDER)
+#define BUDDY_ORDERS     (BUDDY_MAX_ORDER - BUDDY_MIN_ORDER + 1)
+
+// smallest buddy blocks in a superblock
+#define BUDDY_UNITS      (1 << (BUDDY_MAX_ORDER - BUDDY_MIN_ORDER))
+
+// most superblocks
+#define NSUPER           64
+
+/** Free buddy block */
+typedef struct FreeBlock {
+    struct FreeBlock *next;
+    struct FreeBlock *prev;
+} FreeBlock;
+
+/** Superblock: state[u] is one more than the order of the free block
+ *  starting at its u-th smallest block, or zero if none starts there */
+typedef struct Superblock {
+    byte *base;
+    uint8 state[BUDDY_UNITS];
+} Superblock;
+
+static Superblock super[NSUPER];
+static int nsuper;
+
+// free buddy blocks of each order
+static FreeBlock *buddyfree[BUDDY_ORDERS];
+
+// large blocks in use
+static uint32 large_in_use;
+
+// used to ensure mutually exclusive access to buddy blocks
+static Mutex mutex_buddy;
+
+/**
+ * Returns index for a large block that can hold given size (bytes),
+ * or -1 if there is none
+ */
+static int large_index(uint size)
+{
+    int order = BUDDY_MIN_ORDER;
+    while (order <= BUDDY_MAX_ORDER && ((uint32)1 << order) < size) {
+        order++;
+    }
+    return (order <= BUDDY_MAX_ORDER) ? 
+               LARGE_INDEX + order - BUDDY_MIN_ORDER : -1;
+}
+
+/**
+ * Returns superblock holding given address
+ */
+static Superblock *find_super(byte *addr)
+{
+    int i;
+    for (i = 0; i < nsuper; i++) {
+        if (addr >= super[i].base && addr < super[i].base + BUDDY_MAX)
+            return &super[i];
+    }
+    plotz("Large block not found");
+    return NULL;
+}
+
+/**
+ * Puts free buddy block of given order on its list.
+ * Caller must hold mutex_buddy.
+ */
+static void push_free(Superblock *sb, byte *addr, int order)
+{
+    FreeBlock *fb = (FreeBlock *)addr;
+    FreeBlock **head = &buddyfree[order - BUDDY_MIN_ORDER];
+    fb->prev = NULL;
+    fb->next = *head;
+    if (*head != NULL) (*head)->prev = fb;
+    *head = fb;
+    sb->state[(addr - sb->base) >> BUDDY_MIN_ORDER] = order + 1;
+}
+
+/**
+ * Takes free buddy block of given order off its list.
+ * Caller must hold mutex_buddy.
+ */
+static void remove_free(Superblock *sb, byte *addr, int order)
+{
+    FreeBlock *fb = (FreeBlock *)addr;
+    if (fb->prev != NULL) 
+        fb->prev->next = fb->next;
+    else 
+        buddyfree[order - BUDDY_MIN_ORDER] = fb->next;
+    if (fb->next != NULL) fb->next->prev = fb->prev;
+    sb->state[(addr - sb->base) >> BUDDY_MIN_ORDER] = 0;
+}
+
+/**
+ * Adds a superblock taken from the arenas, nearest the given unit's
+ * first, returning false if there is no room.
+ * Caller must hold mutex_buddy.
+ */
+static _Bool add_super(int pun)
+{
+    if (nsuper == NSUPER) return false;
+    byte *base = NULL;
+    int k;
+    for (k = 0; k < NPUN && base == NULL; k++)
+    {
+        Arena *a = &arena[(pun + k) % NPUN];
+        claim_mutex(&a->mutex);
+        base = carve(a, BUDDY_MAX, MEM_PAGE_SIZE);
+        release_mutex(&a->mutex);
+    }
+    if (base == NULL) return false;
+
+    Superblock *sb = &super[nsuper++];
+    sb->base = base;
+    int u;
+    for (u = 0; u < BUDDY_UNITS; u++) {
+        sb->state[u] = 0;
+    }
+    push_free(sb, base, BUDDY_MAX_ORDER);
+    return true;
+}
+
+/**
+ * Allocates large block of given order, or returns NULL if out of memory
+ */
+static byte *allocate_large(int order, int pun)
+{
+    claim_mutex(&mutex_buddy);
+
+    // find smallest free block big enough, adding a superblock if none
+    int k = order;
+    while (k <= BUDDY_MAX_ORDER && buddyfree[k - BUDDY_MIN_ORDER] == NULL) {
+        k++;
+    }
+    if (k > BUDDY_MAX_ORDER) {
+        if (!add_super(pun)) {
+            release_mutex(&mutex_buddy);
+            return NULL;
+        }
+        k = BUDDY_MAX_ORDER;
+    }
+
+    byte *block = (byte *)buddyfree[k - BUDDY_MIN_ORDER];
+    Superblock *sb = find_super(block);
+    remove_free(sb, block, k);
+
+    // split it, freeing the upper halves
+    while (k > order) {
+        k--;
+        push_free(sb, block + ((uint32)1 << k), k);
+    }
+    large_in_use++;
+
+    release_mutex(&mutex_buddy);
+    return block;
+}
+
+/**
+ * Releases large block of given order, merging it with its buddy
+ * for as long as the buddy is free
+ */
+static void release_large(int order, byte *addr)
+{
+    claim_mutex(&mutex_buddy);
+    Superblock *sb = find_super(addr);
+    uint32 offset = addr - sb->base;
+    while (order < BUDDY_MAX_ORDER)
+    {
+        uint32 buddy = offset ^ ((uint32)1 << order);
+        if (sb->state[buddy >> BUDDY_MIN_ORDER] != order + 1) break;
+        remove_free(sb, sb->base + buddy, order);
+        if (buddy < offset) offset = buddy;
+        order++;
+    }
+    push_free(sb, sb->base + offset, order);
+    large_in_use--;
+    release_mutex(&mutex_buddy);
+}
+
+/** 
+ * Allocate block of length implied by index from given unit's 
+ * arena, or return NULL if out of memory
+ */
+static byte *allocate_block(uint16 index, int pun)
+{
+    if (index >= LARGE_INDEX) {
+        byte *large = allocate_large(index - LARGE_INDEX + BUDDY_MIN_ORDER, pun);
+        if (large == NULL) {
+            atomic_fetch_add(&failed, 1);
+        }
+        return large;
+    }
+
+    ChainedBlock_p block = NULL;
+    UnitCache *cache = (caching && pun == getcpu()) ? &unitcache[pun] : NULL;
+    if (cache != NULL &&
+        !atomic_exchange_explicit(&cache->busy, true, memory_order_acquire))
+    {
+        // take block from this unit's magazine
+        Magazine *mag = &cache->mag[index];
+        if (mag->count == 0) {
+            refill(mag, &arena[pun], index);
+        }
+        block = mag->blocks;
+        if (block != NULL) {
+            mag->blocks = block->next;
+            mag->count--;
+            mag->allocs++;
+        }
+        atomic_store_explicit(&cache->busy, false, memory_order_release);
+    }
+    if (block == NULL)
+    {
+        // magazines in use or arena used up, go to the arenas
+        block = take_block_near(pun, index);
+    }
+
+    if (block == NULL) {
+        atomic_fetch_add(&failed, 1);
     }
-    
-    release_mutex(&mutex_mem);
     return (byte *)block;
 }
 
+/**
+ * Returns the unit whose arena the current process allocates from
+ */
+static int this_unit()
+{
+    return caching ? getcpu() : 0;
+}
+
+/** 
+ * Allocate block of length implied by index, or return NULL if
+ * out of memory
+ * input:   index    1..NALLOC-1
+ * output:  array of words of size corresponding to index
+ */
+byte *try_allocate_mem(uint16 index)
+{
+    return allocate_block(index, this_unit());
+}
+
+/** 
+ * Allocate block of length implied by index
+ * input:   index    1..NALLOC-1
+ * output:  array of words of size corresponding to index
+ */
+byte *allocate_mem(uint16 index)
+{
+    byte *block = allocate_block(index, this_unit());
+    if (block == NULL) {
+        plotz("Out of memory");
+    }
+    return block;
+}
+
+/** 
+ * Allocate block of length implied by index in memory local to
+ * the given processing unit
+ * input:   index    1..NALLOC-1
+ *          pun      processing unit
+ * output:  array of words of size corresponding to index
+ */
+byte *allocate_mem_on(uint16 index, int pun)
+{
+    byte *block = allocate_block(index, pun);
+    if (block == NULL) {
+        plotz("Out of memory");
+    }
+    return block;
+}
+
 /**
  * Release allocated block.
  * input:   index     1..NALLOC-1
@@ -99,29 +654,239 @@ byte *allocate_mem(uint16 index)
  */
 void release_mem(uint16 index, byte *addr)
 {
-    // put released block at head of list for its size
-    claim_mutex(&mutex_mem);
+    if (index >= LARGE_INDEX) {
+        release_large(index - LARGE_INDEX + BUDDY_MIN_ORDER, addr);
+        return;
+    }
+
     ChainedBlock_p block = (ChainedBlock_p)addr;
-    block->next = procmemlist[index];
-    procmemlist[index] = block;
-    release_mutex(&mutex_mem);
+    int pun = this_unit();
+    UnitCache *cache = (caching && home_arena(addr) == pun) 
+                           ? &unitcache[pun] : NULL;
+    if (cache != NULL &&
+        !atomic_exchange_explicit(&cache->busy, true, memory_order_acquire))
+    {
+        // put released block in this unit's magazine
+        Magazine *mag = &cache->mag[index];
+        if (mag->count == MAG_MAX) {
+            spill(mag, &arena[pun], index);
+        }
+        block->next = mag->blocks;
+        mag->blocks = block;
+        mag->count++;
+        mag->releases++;
+        atomic_store_explicit(&cache->busy, false, memory_order_release);
+    }
+    else
+    {
+        // magazines in use, or block from another unit's arena: 
+        // put released block at head of its arena's list
+        put_block(block, index);
+    }
 }
 
 /**
  * Initializes the memory system.
  * input:    total   size of total dynamic memory allocation, in bytes
+ *           lens    allocatable lengths, ascending (NULL for default)
+ *           n       number of lengths
  */
-void memory_init(uint total)
+void memory_init(uint total, const uint32 lens[], int n)
 {
-    // set allocatable lengths, none allocated yet
+    // set allocatable lengths
+    if (lens == NULL) {
+        lens = default_lens;
+        n = sizeof(default_lens) / sizeof(default_lens[0]);
+    }
+    set_lengths(lens, n);
     int i;
-    for (i = 0; i < NALLOC; i++)
+    atomic_init(&failed, 0);
+
+    // no large blocks yet
+    init_mutex(&mutex_buddy);
+    nsuper = 0;
+    large_in_use = 0;
+    for (i = 0; i < BUDDY_ORDERS; i++) {
+        buddyfree[i] = NULL;
+    }
+
+    // divide memory into arenas on page boundaries, 
+    // each placed near its unit, none allocated yet
+    // (memory is committed in whole pages, so any part 
+    // page at the end would be unusable)
+    total &= ~(uint32)(MEM_PAGE_SIZE - 1);
+    region = (byte *)acquire_memory(total); 
+    arenalen = (total / NPUN) & ~(uint32)(MEM_PAGE_SIZE - 1);
+    if (arenalen == 0) {
+        plotz("Too little memory for arenas");
+    }
+    int pun;
+    for (pun = 0; pun < NPUN; pun++)
     {
-        procmemlist[i] = NULL;
+        Arena *a = &arena[pun];
+        init_mutex(&a->mutex);
+        a->tail = region + pun * arenalen;
+        a->len = (pun < NPUN - 1) ? arenalen : total - pun * arenalen;
+        a->taillen = a->len;
+        a->committed = a->tail;
+        for (i = 0; i < NALLOC; i++)
+        {
+            a->list[i] = NULL;
+            a->carved[i] = a->allocs[i] = a->releases[i] = 0;
+        }
+        place_memory((char *)a->tail, a->len, pun);
+    }
+
+    // magazines start out empty, and unused until 
+    // memory_cache_init is called
+    caching = false;
+    for (pun = 0; pun < NPUN; pun++) 
+    {
+        atomic_init(&unitcache[pun].busy, false);
+        for (i = 0; i < NALLOC; i++) {
+            unitcache[pun].mag[i].blocks = NULL;
+            unitcache[pun].mag[i].count = 0;
+            unitcache[pun].mag[i].allocs = 0;
+            unitcache[pun].mag[i].releases = 0;
+        }
     }
-    
-    tail = acquire_memory(total); 
-    taillen = total;
 }
 
+/**
+ * Gives the memory behind released blocks on the arenas' lists, and
+ * behind free large blocks, back to the system (apart from the page 
+ * holding each block's links).  Only blocks spanning whole pages are 
+ * affected.  Blocks cached in the units' magazines, which are likely
+ * to be reused soon, are not.  No note is kept of how long a block
+ * has been free: every such block is trimmed, however recently it was
+ * released, and its pages are supplied afresh (zeroed) when it is 
+ * next used.
+ */
+void release_idle_memory()
+{
+    int pun;
+    for (pun = 0; pun < NPUN; pun++)
+    {
+        Arena *a = &arena[pun];
+        claim_mutex(&a->mutex);
+        int i;
+        for (i = 0; procmemlen[i]; i++)
+        {
+            if (procmemlen[i] < 2 * MEM_PAGE_SIZE) continue;
+            ChainedBlock_p block;
+            for (block = a->list[i]; block != NULL; block = block->next)
+            {
+                Addr from = ((Addr)block->data + MEM_PAGE_SIZE - 1) 
+                                & ~(Addr)(MEM_PAGE_SIZE - 1);
+                Addr to = ((Addr)block + procmemlen[i]) 
+                                & ~(Addr)(MEM_PAGE_SIZE - 1);
+                if (to > from) {
+                    discard_memory((char *)from, to - from);
+                }
+            }
+        }
+        release_mutex(&a->mutex);
+    }
 
+    // likewise free large blocks
+    claim_mutex(&mutex_buddy);
+    int k;
+    for (k = BUDDY_MIN_ORDER; k <= BUDDY_MAX_ORDER; k++)
+    {
+        FreeBlock *fb;
+        for (fb = buddyfree[k - BUDDY_MIN_ORDER]; fb != NULL; fb = fb->next)
+        {
+            Addr from = ((Addr)(fb + 1) + MEM_PAGE_SIZE - 1) 
+                            & ~(Addr)(MEM_PAGE_SIZE - 1);
+            Addr to = ((Addr)fb + ((uint32)1 << k)) 
+                            & ~(Addr)(MEM_PAGE_SIZE - 1);
+            if (to > from) {
+                discard_memory((char *)from, to - from);
+            }
+        }
+    }
+    release_mutex(&mutex_buddy);
+}
+
+/**
+ * Starts using the per-unit magazines.  Called once the initial 
+ * processing unit is active (so that each unit can identify itself).
+ */
+void memory_cache_init()
+{
+    caching = true;
+}
+
+/**
+ * Gets allocator statistics.  Counts kept in the per-unit magazines are
+ * read without stopping the units, so while processes are allocating
+ * the figures are approximate.
+ */
+void get_mem_stats(MemStats *stats)
+{
+    stats->total = stats->tail_left = stats->committed = 0;
+    stats->failed = atomic_load(&failed);
+    int i;
+    for (i = 0; procmemlen[i]; i++)
+    {
+        MemClassStats *cls = &stats->cls[i];
+        cls->len = procmemlen[i];
+        cls->allocated = cls->released = cls->carved = 0;
+    }
+    stats->nclasses = i;
+
+    int pun;
+    for (pun = 0; pun < NPUN; pun++)
+    {
+        Arena *a = &arena[pun];
+        claim_mutex(&a->mutex);
+        stats->total += a->len;
+        stats->tail_left += a->taillen;
+        byte *start = a->tail + a->taillen - a->len;   // start of arena
+        stats->committed += a->committed - start;
+        for (i = 0; i < stats->nclasses; i++) 
+        {
+            MemClassStats *cls = &stats->cls[i];
+            cls->allocated += a->allocs[i] + unitcache[pun].mag[i].allocs;
+            cls->released += a->releases[i] + unitcache[pun].mag[i].releases;
+            cls->carved += a->carved[i];
+        }
+        release_mutex(&a->mutex);
+    }
+
+    stats->tail_used = stats->total - stats->tail_left;
+
+    claim_mutex(&mutex_buddy);
+    stats->large_in_use = large_in_use;
+    stats->large_space = nsuper * BUDDY_MAX;
+    release_mutex(&mutex_buddy);
+    for (i = 0; i < stats->nclasses; i++) 
+    {
+        MemClassStats *cls = &stats->cls[i];
+        cls->in_use = cls->allocated - cls->released;
+        cls->free = cls->carved - cls->in_use;
+    }
+}
+
+/**
+ * Prints allocator statistics
+ */
+void print_mem_stats()
+{
+    MemStats stats;
+    get_mem_stats(&stats);
+    printf("memory: %u bytes, %u committed, %u used from tail, %u left, "
+        "%u failed\n", stats.total, stats.committed, stats.tail_used, 
+        stats.tail_left, stats.failed);
+    printf("large blocks: %u in use, %u bytes of space\n",
+        stats.large_in_use, stats.large_space);
+    printf("%8s %10s %10s %8s %8s %8s\n", 
+        "len", "allocated", "released", "in use", "free", "carved");
+    int i;
+    for (i = 0; i < stats.nclasses; i++) {
+        MemClassStats *cls = &stats.cls[i];
+        if (cls->carved == 0) continue;
+        printf("%8u %10u %10u %8u %8u %8u\n", cls->len, cls->allocated,
+            cls->released, cls->in_use, cls->free, cls->carved);
+    }
+}
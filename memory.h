@@ -21,17 +21,34 @@
 
 #include "mutex.h"
 #include "types.h"
+#include <stddef.h>
 
 /* 
  * We use Brinch Hansen's memory allocation algorithm.
  * Assume that the program is small, so that the size of every
  * possible storage allocation is known beforehand, and each
- * possible size can be assigned an index.  Thus there
- * no need for a fallback "hard" allocation scheme.
+ * possible size can be assigned an index.  Requests larger than
+ * every size fall back on a buddy allocator (see LARGE_INDEX).
  */
 
 // memory index of timeout descriptor
 #define TMO_INDEX 0
+
+// every block starts on a boundary of MEM_ALIGN bytes, so it can hold
+// an object of any type not declared with a stricter _Alignas (blocks
+// of whole cache lines start on a line)
+#define MEM_ALIGN  _Alignof(max_align_t)
+
+// maximum number of memory allocation sizes
+#define NALLOC  24
+
+// Requests larger than the largest allocation size get large blocks,
+// whose lengths are powers of two from 2^BUDDY_MIN_ORDER up to 
+// 2^BUDDY_MAX_ORDER bytes.  A large block's index is LARGE_INDEX or
+// more.
+#define BUDDY_MIN_ORDER  12
+#define BUDDY_MAX_ORDER  22
+#define LARGE_INDEX      NALLOC
  
 // fwd decl of 'struct ChainedBlock' as type 'ChainedBlock'
 typedef struct ChainedBlock ChainedBlock;
@@ -50,6 +67,18 @@ typedef struct ChainedBlock {
  */
 int find_mem_index(uint size);
 
+/*
+ * Find index of smallest allocation >= given size, or return -1
+ * if the size is larger than any block
+ */
+int try_find_mem_index(uint size);
+
+/*
+ * Find index of smallest allocation >= given size whose blocks
+ * start on a cache line boundary
+ */
+int find_line_mem_index(uint size);
+
 /* 
  * Allocate block of length implied by index
  * input:   index    1..NALLOC-1
@@ -57,6 +86,18 @@ int find_mem_index(uint size);
  */
 byte *allocate_mem(uint16 index);
 
+/* 
+ * Allocate block of length implied by index, or return NULL
+ * if out of memory
+ */
+byte *try_allocate_mem(uint16 index);
+
+/* 
+ * Allocate block of length implied by index in memory local
+ * to the given processing unit
+ */
+byte *allocate_mem_on(uint16 index, int pun);
+
 /*
  * Release allocated block.
  * input:   index     1..NALLOC-1
@@ -67,8 +108,57 @@ void release_mem(uint16 index, byte *addr);
 /*
  * Initializes the memory system.
  * input:    total   size of total dynamnic memory allocation, in bytes
+ *           lens    allocatable lengths, ascending (NULL for default)
+ *           n       number of lengths
+ */
+void memory_init(uint total, const uint32 lens[], int n);
+
+/*
+ * Starts using the per-unit caches of free blocks.
+ * Called once the initial processing unit is active.
+ */
+void memory_cache_init();
+
+/* Statistics of one allocatable length */
+typedef struct MemClassStats {
+    uint32 len;          // block length, bytes
+    uint32 allocated;    // allocations made
+    uint32 released;     // releases made
+    uint32 in_use;       // blocks allocated and not yet released
+    uint32 free;         // released blocks, available for reuse
+    uint32 carved;       // blocks taken from tail (no block goes back
+                         // to it, so at least the most ever in use)
+} MemClassStats;
+
+/* Allocator statistics */
+typedef struct MemStats {
+    uint32 total;        // size of allocatable memory, bytes
+    uint32 committed;    // bytes of it committed
+    uint32 tail_used;    // bytes taken from tail (incl. alignment)
+    uint32 tail_left;    // bytes left in tail
+    uint32 failed;       // requests that could not be met
+    uint32 large_in_use; // large blocks in use
+    uint32 large_space;  // bytes taken from tail for large blocks
+    int nclasses;        // number of allocatable lengths
+    MemClassStats cls[NALLOC];
+} MemStats;
+
+/*
+ * Gives the memory behind large released blocks back to the system.
+ * Trims every such block that is free when called, however recently
+ * it was released (blocks in the per-unit caches excepted).
+ */
+void release_idle_memory();
+
+/*
+ * Gets allocator statistics (approximate while processes allocate)
+ */
+void get_mem_stats(MemStats *stats);
+
+/*
+ * Prints allocator statistics
  */
-void memory_init(uint total);
+void print_mem_stats();
 
 #endif
 
@@ -0,0 +1,46 @@
+
+/**
+ *  CXP   C eXecutive Program
+ *  Copyright (c) 2014 Michael E. Goldsby
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pool.h"
+#include "memory.h"
+#include "types.h"
+
+/** Initializes pool of objects of given length */
+void init_pool(Pool *pool, uint len)
+{
+    pool->len = len;
+    pool->index = find_mem_index(len);
+}
+
+/** Gets an object from the pool */
+void *pool_get(Pool *pool)
+{
+    return allocate_mem(pool->index);
+}
+
+/** Gets an object from the pool, or NULL if memory is used up */
+void *pool_try_get(Pool *pool)
+{
+    return try_allocate_mem(pool->index);
+}
+
+/** Puts an object back in the pool it came from */
+void pool_put(Pool *pool, void *obj)
+{
+    release_mem(pool->index, (byte *)obj);
+}
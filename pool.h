@@ -0,0 +1,65 @@
+
+/**
+ *  CXP   C eXecutive Program
+ *  Copyright (c) 2014 Michael E. Goldsby
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include "memory.h"
+#include "types.h"
+
+/*---------------------------------------------------------------------
+ |  A pool hands out objects of one fixed length from the executive's
+ |  own allocator, for use by application processes in place of 
+ |  malloc.  Objects come from the allocating unit's cache of free 
+ |  blocks of that length, and an object put back on the unit where
+ |  its memory lives goes back into that cache, so most gets and puts
+ |  claim no mutex.  An object (or the pool itself) can be sent over 
+ |  a channel and put back by a process on any unit.  Every object
+ |  is aligned for any type not declared with a stricter _Alignas 
+ |  (see MEM_ALIGN).  init_typed_pool rejects such a type.
+ *--------------------------------------------------------------------*/
+
+typedef struct Pool {
+    uint len;                     // length of object, in bytes
+    uint16 index;                 // memory class of objects
+} Pool;
+
+/** Initializes pool of objects of given length */
+void init_pool(Pool *pool, uint len);
+
+/** Gets an object from the pool */
+void *pool_get(Pool *pool);
+
+/** Gets an object from the pool, or NULL if memory is used up */
+void *pool_try_get(Pool *pool);
+
+/** Puts an object back in the pool it came from */
+void pool_put(Pool *pool, void *obj);
+
+/** Initializes pool for objects of type T */
+#define init_typed_pool(pool, T)                                 \
+  do {                                                           \
+      _Static_assert(_Alignof(T) <= MEM_ALIGN,                   \
+                     "Type aligned beyond MEM_ALIGN");           \
+      init_pool(pool, sizeof(T));                                \
+  } while (0)
+
+/** Gets an object of type T from the pool */
+#define pool_get_typed(pool, T)    ((T *)pool_get(pool))
+
+#endif
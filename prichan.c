@@ -0,0 +1,183 @@
+
+/**
+ *  CXP   C eXecutive Program
+ *  Copyright (c) 2014 Michael E. Goldsby
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "prichan.h"
+#include "memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dbg.h"
+
+/** Makes waiting process ready */
+static void wake(Process *proc)
+{
+    int old_state = atomic_exchange_explicit(
+        &proc->sched_state, PROC_READY, memory_order_acq_rel);
+
+    // if process was waiting, schedule it
+    // (otherwise, state was PROC_PREPARING_TO_WAIT, and process 
+    // is either executing or already in its scheduling queue)
+    if (old_state == PROC_WAITING) {
+        schedule(proc);
+    }
+}
+
+/** Puts writer on the list of writers waiting for space, after those
+ *  of its priority already there or, if 'first', ahead of them */
+static void add_waiter(PriChannel *pc, PriWaiter *waiter, _Bool first)
+{
+    PriWaiter **link = &pc->writers;
+    while (*link != NULL && 
+           ((*link)->pri < waiter->pri || 
+            (!first && (*link)->pri == waiter->pri))) {
+        link = &(*link)->next;
+    }
+    waiter->next = *link;
+    *link = waiter;
+}
+
+/** Initializes priority channel holding up to 'capacity' 
+ *  messages of up to 'msglen' bytes each */
+void init_pri_channel(PriChannel *pc, uint capacity, uint msglen)
+{
+    if (capacity == 0) plotz("init_pri_channel zero capacity");
+
+    init_mutex(&pc->mutex);
+    pc->nonempty = 0;
+    int p;
+    for (p = 0; p < PRICHAN_LEVELS; p++) {
+        pc->head[p] = NULL;
+        pc->tail[p] = NULL;
+    }
+    pc->reader = NULL;
+    pc->writers = NULL;
+    pc->msglen = msglen;
+
+    // carve buffer into slots, word-aligned, and chain them as free
+    uint slotlen = (sizeof(PriMsg) + msglen + sizeof(Word) - 1) 
+                        & ~(sizeof(Word) - 1);
+    pc->index = find_mem_index(capacity * slotlen);
+    pc->buf = allocate_mem(pc->index);
+    pc->free = NULL;
+    int i;
+    for (i = capacity - 1; i >= 0; i--) {
+        PriMsg *msg = (PriMsg *)(pc->buf + i * slotlen);
+        msg->next = pc->free;
+        pc->free = msg;
+    }
+}
+
+/** Writes message with given priority (0 most urgent) */
+void pri_out(PriChannel *pc, Word *paramSrc, uint len, uint pri)
+{
+    if (pri >= PRICHAN_LEVELS) plotz("pri_out invalid priority");
+    if (len > pc->msglen) plotz("pri_out message too long");
+
+    Process *curr = get_current();
+    claim_mutex(&pc->mutex);   // claim exclusive access to this channel
+
+    // wait until there is a free slot
+    _Bool woken = false;
+    while (pc->free == NULL) 
+    {
+        // join the waiting writers, in order of priority and then
+        // of arrival (a writer that was freed but found its slot
+        // taken by a writer that did not wait goes back first)
+        PriWaiter waiter;
+        waiter.proc = curr;
+        waiter.pri = pri;
+        add_waiter(pc, &waiter, woken);
+        PREPARE_TO_WAIT(curr);
+        release_mutex(&pc->mutex);   // release exclusive access
+        relinquish();
+        // when this process resumes, the reader has taken it
+        // off the list and freed a slot (which another writer
+        // may have taken first, so look again)
+        claim_mutex(&pc->mutex);   // claim exclusive access
+        woken = true;
+    }
+
+    // copy message into slot and append slot to its priority's FIFO
+    PriMsg *msg = pc->free;
+    pc->free = msg->next;
+    memcpy(msg->data, paramSrc, len);
+    msg->len = len;
+    msg->next = NULL;
+    if (pc->head[pri] == NULL) {
+        pc->head[pri] = msg;
+        pc->nonempty |= (1u << pri);
+    } else {
+        pc->tail[pri]->next = msg;
+    }
+    pc->tail[pri] = msg;
+
+    // if reader waiting, free it
+    Process *reader = pc->reader;
+    pc->reader = NULL;
+    release_mutex(&pc->mutex);   // release exclusive access
+    if (reader != NULL) {
+        wake(reader);
+    }
+}
+
+/** Reads most urgent message, returns its length */
+uint pri_in(PriChannel *pc, Word *paramDest)
+{
+    Process *curr = get_current();
+    claim_mutex(&pc->mutex);   // claim exclusive access to this channel
+
+    // wait until there is a message
+    while (pc->nonempty == 0) 
+    {
+        pc->reader = curr;
+        PREPARE_TO_WAIT(curr);
+        release_mutex(&pc->mutex);   // release exclusive access
+        relinquish();
+        claim_mutex(&pc->mutex);   // claim exclusive access
+    }
+
+    // most urgent nonempty FIFO is lowest bit set
+    int pri = __builtin_ctz(pc->nonempty);
+    PriMsg *msg = pc->head[pri];
+    pc->head[pri] = msg->next;
+    if (msg->next == NULL) {
+        pc->tail[pri] = NULL;
+        pc->nonempty &= ~(1u << pri);
+    }
+
+    // copy message out and free its slot
+    uint len = msg->len;
+    memcpy(paramDest, msg->data, len);
+    msg->next = pc->free;
+    pc->free = msg;
+
+    // if a writer is waiting for space, free it
+    PriWaiter *waiter = pc->writers;
+    Process *writer = NULL;
+    if (waiter != NULL) {
+        writer = waiter->proc;
+        pc->writers = waiter->next;
+        // (waiter lives on the writer's stack, so let go of it
+        // before the writer runs)
+    }
+    release_mutex(&pc->mutex);   // release exclusive access
+    if (writer != NULL) {
+        wake(writer);
+    }
+    return len;
+}
@@ -0,0 +1,80 @@
+
+/**
+ *  CXP   C eXecutive Program
+ *  Copyright (c) 2014 Michael E. Goldsby
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PRICHAN_H
+#define PRICHAN_H
+
+#include "mutex.h"
+#include "sched.h"
+#include "types.h"
+
+/*---------------------------------------------------------------------
+ |  A priority channel is a buffered channel from any number of
+ |  writers to one reader.  Each message carries a priority given
+ |  by its writer, and the reader always takes the oldest message
+ |  of the most urgent priority present.  Messages of each priority
+ |  form a FIFO, and a bitmap of the nonempty FIFOs lets the reader
+ |  find the most urgent one with a single bit scan.  A writer
+ |  waits only when the buffer is full, and the reader only when it
+ |  is empty.  Writers waiting for space get it in order of priority,
+ |  and in arrival order within a priority.
+ *--------------------------------------------------------------------*/
+
+#define PRICHAN_LEVELS  32     // priorities 0 (most urgent) .. 31
+
+typedef struct PriMsg PriMsg;
+typedef struct PriWaiter PriWaiter;
+
+/** Buffered message */
+typedef struct PriMsg {
+    PriMsg *next;             // next message in FIFO or free list
+    uint len;                 // length of message
+    Word data[];              // message
+} PriMsg;
+
+/** Writer waiting for buffer space */
+typedef struct PriWaiter {
+    Process *proc;
+    uint pri;                 // priority of writer's message
+    PriWaiter *next;
+} PriWaiter;
+
+typedef struct PriChannel {
+    Mutex mutex;
+    uint32 nonempty;                  // bit p set if FIFO p nonempty
+    PriMsg *head[PRICHAN_LEVELS];     // oldest message of each priority
+    PriMsg *tail[PRICHAN_LEVELS];     // newest message of each priority
+    PriMsg *free;                     // unused buffer slots
+    Process *reader;                  // reader waiting for a message
+    PriWaiter *writers;               // writers waiting for space
+    uint msglen;                      // maximum message length
+    uint16 index;                     // memory class of the buffer
+    byte *buf;                        // the buffer slots
+} PriChannel;
+
+/** Initializes priority channel holding up to 'capacity' (at least
+ *  one) messages of up to 'msglen' bytes each */
+void init_pri_channel(PriChannel *pc, uint capacity, uint msglen);
+
+/** Writes message with given priority (0 most urgent) */
+void pri_out(PriChannel *pc, Word *paramSrc, uint len, uint pri);
+
+/** Reads most urgent message, returns its length */
+uint pri_in(PriChannel *pc, Word *paramDest);
+
+#endif
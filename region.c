@@ -0,0 +1,69 @@
+
+/**
+ *  CXP   C eXecutive Program
+ *  Copyright (c) 2014 Michael E. Goldsby
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "region.h"
+#include "memory.h"
+#include "sched.h"
+#include "types.h"
+#include <stdio.h>
+
+/** Allocates memory from the current process's region */
+void *region_alloc(uint len)
+{
+    Process *curr = get_current();
+    RegionChunk *chunk = curr->region;
+
+    // round up to keep allocations aligned
+    len = (len + REGION_ALIGN - 1) & ~(REGION_ALIGN - 1);
+
+    if (chunk == NULL || chunk->limit - chunk->free < len)
+    {
+        // start a new chunk, big enough for the request
+        // (what is left of the old one is abandoned)
+        uint hdrlen = (sizeof(RegionChunk) + REGION_ALIGN - 1) 
+                          & ~(REGION_ALIGN - 1);
+        uint chunklen = hdrlen + len;
+        if (chunklen < REGION_CHUNK) {
+            chunklen = REGION_CHUNK;
+        }
+        int index = find_mem_index(chunklen);
+        RegionChunk *fresh = (RegionChunk *)allocate_mem(index);
+        fresh->next = chunk;
+        fresh->free = (byte *)fresh + hdrlen;
+        fresh->limit = (byte *)fresh + chunklen;
+        fresh->index = index;
+        curr->region = chunk = fresh;
+    }
+
+    // bump the pointer
+    void *mem = chunk->free;
+    chunk->free += len;
+    return mem;
+}
+
+/** Releases all of a process's region */
+void release_region(Process *proc)
+{
+    RegionChunk *chunk = proc->region;
+    while (chunk != NULL) {
+        RegionChunk *next = chunk->next;
+        release_mem(chunk->index, (byte *)chunk);
+        chunk = next;
+    }
+    proc->region = NULL;
+}
@@ -0,0 +1,56 @@
+
+/**
+ *  CXP   C eXecutive Program
+ *  Copyright (c) 2014 Michael E. Goldsby
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef REGION_H
+#define REGION_H
+
+#include "memory.h"
+#include "sched.h"
+#include "types.h"
+
+/*---------------------------------------------------------------------
+ |  Each process has a region: memory it can allocate from with a 
+ |  pointer bump and never free piecemeal.  The region grows in 
+ |  chunks taken from the allocator as needed, and all of it is 
+ |  released when the process terminates.  Only the owning process
+ |  allocates from its region, so no locking is needed.
+ *--------------------------------------------------------------------*/
+
+// usual length of a region chunk, in bytes
+#define REGION_CHUNK  4096
+
+// alignment of region allocations, in bytes (chunks come from the
+// allocator, so start on a boundary at least this strict)
+#define REGION_ALIGN  MEM_ALIGN
+
+/** Chunk of a process's region */
+typedef struct RegionChunk {
+    struct RegionChunk *next;     // previous chunk
+    byte *free;                   // next free byte
+    byte *limit;                  // end of chunk
+    uint16 index;                 // memory class of chunk
+} RegionChunk;
+
+/** Allocates memory from the current process's region; it is freed 
+ *  when the process terminates */
+void *region_alloc(uint len);
+
+/** Releases all of a process's region (called at termination) */
+void release_region(Process *proc);
+
+#endif
@@ -0,0 +1,131 @@
+
+/**
+ *  CXP   C eXecutive Program
+ *  Copyright (c) 2014 Michael E. Goldsby
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sample.h"
+#include "alt.h"
+#include "memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dbg.h"
+
+/** Initializes sample channel for values of given length */
+void init_sample_channel(SampleChannel *sc, uint len)
+{
+    sc->len = len;
+    sc->index = find_mem_index(3 * len);
+    sc->buf = allocate_mem(sc->index);
+    sc->front = 0;
+    atomic_init(&sc->middle, 1);     // (nothing fresh yet)
+    sc->back = 2;
+    atomic_init(&sc->alting, false);
+    atomic_init(&sc->waiting, NULL);
+}
+
+/** Returns true if the channel holds a value not yet read */
+static inline _Bool fresh(SampleChannel *sc)
+{
+    return (atomic_load(&sc->middle) & SAMPLE_FRESH) != 0;
+}
+
+/** Writes value to sample channel, replacing any held value */
+void sample_out(SampleChannel *sc, Word *paramSrc)
+{
+    // fill writer's slot, then trade it for the middle slot
+    memcpy(sc->buf + sc->back * sc->len, paramSrc, sc->len);
+    uint8 old = atomic_exchange(&sc->middle, sc->back | SAMPLE_FRESH);
+    sc->back = old & SAMPLE_SLOT;
+
+    // if reader waiting for a value, free it
+    Process *reader = atomic_exchange(&sc->waiting, NULL);
+    if (reader != NULL) {
+        if (atomic_load(&sc->alting)) {
+            freeProcessMaybe(reader);
+        } else {
+            // make the receiving process ready
+            int old_state = atomic_exchange_explicit(
+                &reader->sched_state, PROC_READY, memory_order_acq_rel);
+
+            // if receiving process was waiting, schedule it
+            if (old_state == PROC_WAITING) {
+                schedule(reader);
+            }
+        }
+    }
+}
+
+/** Reads latest value from sample channel, waiting if nothing new */
+void sample_in(SampleChannel *sc, Word *paramDest)
+{
+    Process *curr = get_current();
+    while (!fresh(sc)) 
+    {
+        // let writer know this process is waiting, then look again
+        // in case the writer came by in the meantime
+        PREPARE_TO_WAIT(curr);
+        atomic_store(&sc->alting, false);
+        atomic_store(&sc->waiting, curr);
+        if (fresh(sc)) {
+            if (atomic_exchange(&sc->waiting, NULL) == curr) {
+                // withdrew before writer saw us
+                atomic_store_explicit(&curr->sched_state, 
+                    PROC_READY, memory_order_release);
+            } else {
+                // writer is freeing us: let it finish
+                relinquish();
+            }
+        } else {
+            relinquish();
+        }
+    }
+
+    // trade reader's slot for the middle slot and read it
+    uint8 old = atomic_exchange(&sc->middle, sc->front);
+    sc->front = old & SAMPLE_SLOT;
+    memcpy(paramDest, sc->buf + sc->front * sc->len, sc->len);
+}
+
+/** 
+ *  Enables sample channel for alt, returns true if new value held. 
+ *  input:  sc      the sample channel
+ *          proc    the alting process
+ *  output: true if new value held
+ */
+_Bool enable_sample(SampleChannel *sc, Process *proc)
+{
+    if (fresh(sc)) {
+        return true;
+    }
+    atomic_store(&sc->alting, true);
+    atomic_store(&sc->waiting, proc);
+    return fresh(sc);
+    // (if ready now, disable_sample withdraws the registration)
+}
+
+/** 
+ *  Disables sample channel for alt, returns true if new value held. 
+ *  input:  sc      the sample channel
+ *          proc    the alting process
+ *  output: true if new value held
+ */
+_Bool disable_sample(SampleChannel *sc, Process *proc)
+{
+    Process *expected = proc;
+    atomic_compare_exchange_strong(&sc->waiting, &expected, NULL);
+    return fresh(sc);
+}
@@ -0,0 +1,65 @@
+
+/**
+ *  CXP   C eXecutive Program
+ *  Copyright (c) 2014 Michael E. Goldsby
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include "sched.h"
+#include "types.h"
+#include <stdatomic.h>
+
+/*---------------------------------------------------------------------
+ |  A sample channel holds the latest value written to it.  Output
+ |  never waits: it replaces the held value.  Input returns the
+ |  latest value, waiting only if nothing has been written since
+ |  the last input.  Values pass through a triple buffer, so the
+ |  writer and reader never wait on each other or on a mutex, even
+ |  on different processing units.  One writer, one reader.
+ *--------------------------------------------------------------------*/
+
+// the middle slot index is tagged when it holds a value not yet read
+#define SAMPLE_FRESH  4
+#define SAMPLE_SLOT   3
+
+typedef struct SampleChannel {
+    _Atomic(uint8) middle;        // slot being handed over (+ fresh flag)
+    uint8 back;                   // slot owned by writer
+    uint8 front;                  // slot owned by reader
+    _Atomic(_Bool) alting;        // reader is waiting in alternation
+    _Atomic(Process *) waiting;   // reader waiting for a value
+    uint len;                     // length of value, in bytes
+    uint16 index;                 // memory class of buffer
+    byte *buf;                    // three slots of 'len' bytes each
+} SampleChannel;
+
+/** Initializes sample channel for values of given length */
+void init_sample_channel(SampleChannel *sc, uint len);
+
+/** Writes value to sample channel, replacing any held value */
+void sample_out(SampleChannel *sc, Word *paramSrc);
+
+/** Reads latest value from sample channel, waiting if nothing new */
+void sample_in(SampleChannel *sc, Word *paramDest);
+
+/** Enables sample channel for alt, returns true if new value held */
+_Bool enable_sample(SampleChannel *sc, Process *proc);
+
+/** Disables sample channel for alt, returns true if new value held */
+_Bool disable_sample(SampleChannel *sc, Process *proc);
+
+#endif
@@ -22,6 +22,7 @@
 #include "hardware.h"
 #include "interrupt.h"
 #include "memory.h"
+#include "region.h"
 #include "run.h"
 #include "timer.h"
 #include "types.h"
@@ -144,15 +145,23 @@ void define_interrupt_handlers()
 /** Builds a process record. */
 static Process_p build_process(uint stacksize, uint pri, uint pun)
 {
-    // allocate process record, including stack
-    int index = find_mem_index(stacksize + sizeof(Process));
-    Process_p proc = (Process_p)allocate_mem(index);
+    // allocate process record, including stack, 
+    // in memory local to the process's unit
+#ifdef PAD_PROCESS
+    // (on a line boundary, as the padded record's alignment requires)
+    int index = find_line_mem_index(
+                    stacksize + STACK_EXTRA + sizeof(Process));
+#else
+    int index = find_mem_index(stacksize + STACK_EXTRA + sizeof(Process));
+#endif
+    Process_p proc = (Process_p)allocate_mem_on(index, pun);
 
     // fill in process record
     proc->next = NULL;
     proc->index = index;
     proc->pri = pri;
     proc->pun = pun;
+    proc->region = NULL;
     proc->alt_state = ATOMIC_VAR_INIT(ALT_NONE);
     proc->sched_state = ATOMIC_VAR_INIT(PROC_WAITING);  
     return proc;
@@ -331,6 +340,53 @@ void schedule(Process *proc)
     enable();
 }
 
+/**-------------------------------------------------------------
+ *  Makes each process in the given chain (linked through 'next')
+ *  ready to execute, interrupting each other processing unit
+ *  involved only once.  The processes must all be waiting.
+ *-------------------------------------------------------------*/
+void schedule_batch(Process *procs)
+{
+    _Bool notify[NPUN] = { false };
+    Process *best = NULL;     // highest-priority process for this unit
+
+    disable();
+    int pun = getcpu();
+    while (procs != NULL) 
+    {
+        Process *proc = procs;
+        procs = proc->next;     // (enqueueing overwrites 'next')
+        if (proc->pun == pun) {
+            // hold back the most urgent one, which may preempt
+            if (best == NULL) {
+                best = proc;
+            } else if (pri_gt(proc->pri, best->pri)) {
+                enqueue0(best);
+                best = proc;
+            } else {
+                enqueue0(proc);
+            }
+        } else {
+            ipq_put(proc->pun, proc, false);
+            notify[proc->pun] = true;
+        }
+    }
+
+    // one interprocessor interrupt per unit
+    int p;
+    for (p = 0; p < NPUN; p++) {
+        if (notify[p]) {
+            send_interprocessor_interrupt(p);
+        }
+    }
+
+    // preempt if necessary
+    if (best != NULL) {
+        schedule0(best);
+    }
+    enable();
+}
+
 /**-------------------------------------------------------------
  *  //Returns the highest priority ready process if it
  *  //has priority higher than currently executing process
@@ -550,8 +606,10 @@ static void finish_termination()
     int pun = oldproc->pun;
     Termination *term = &termination[pun];
 
-    // free the process record (can do this now that
-    // process is using termination stack)
+    // free the process's region and its record (can do 
+    // this now that process is using termination stack)
+    release_region(oldproc);
+    release_context(oldproc);
     release_mem(oldproc->index, (byte *)oldproc);
 
     // disable interrupts
@@ -617,6 +675,11 @@ void terminate()
     Process *curr = get_current();
     int pun = curr->pun;
 
+#ifdef STACK_CHECK
+    // report how much stack the process needed
+    print_stack_usage(curr);
+#endif
+
     // claim exclusive access to the termination strucure for this
     // processor, so this process has sole use of the termination stack
     Termination *term = &termination[pun];
@@ -650,6 +713,17 @@ static void sched_init()
  *  tsize: size of total allocatable memory (bytes) 
  *  istacksize: stack size of initial process  */
 void initialize(unsigned int tsize, unsigned int istacksize)
+{
+    initialize_with_sizes(tsize, istacksize, NULL, 0);
+}
+
+/** Starts the run with the given memory block sizes
+ *  tsize: size of total allocatable memory (bytes) 
+ *  istacksize: stack size of initial process
+ *  sizes: allocatable block sizes (bytes), ascending
+ *  nsizes: number of sizes */
+void initialize_with_sizes(unsigned int tsize, unsigned int istacksize,
+                               const uint32 sizes[], int nsizes)
 {
     // disallow interrupts during initialization
     disable();
@@ -661,7 +735,7 @@ void initialize(unsigned int tsize, unsigned int istacksize)
     /*--------------------------------------------
      | initialize memory module
      -------------------------------------------*/
-    memory_init(tsize - istacksize);
+    memory_init(tsize - istacksize, sizes, nsizes);
     // the currently executing code is the initial process
     // and is already using its stack, at the top of the block
     // of allocatable memory
@@ -698,6 +772,10 @@ void initialize(unsigned int tsize, unsigned int istacksize)
     // activate the initial processor
     activate_processor(0, proc);
 
+    // processors can now identify themselves,
+    // so they can cache memory blocks
+    memory_cache_init();
+
     // make it the current process
     set_current(proc);
 
@@ -78,6 +78,38 @@ typedef void (*code_p)();
 #define PROC_PREPARING_TO_WAIT  1
 #define PROC_WAITING            2
 
+// Define PAD_PROCESS to give the process record fields that other
+// processing units write (alt_state, sched_state) a cache line of
+// their own, apart from the owner's fields and from the stack.  This
+// stops false sharing between units at the cost of two extra cache
+// lines per process, and the record takes a block of the smallest
+// length of whole cache lines that holds it.
+//#define PAD_PROCESS
+#ifdef PAD_PROCESS
+#define PROC_ALIGN  _Alignas(CACHE_LINE_SIZE)
+#else
+#define PROC_ALIGN
+#endif
+
+// Define STACK_CHECK to paint each process's stack when the process
+// is built, so that how much of it the process has used (its high-
+// water mark) can be found with stack_high_water; each process's 
+// usage is also printed when it terminates.
+//#define STACK_CHECK
+
+// Define STACK_GUARD to put an inaccessible guard page below each 
+// process's stack, so that overflowing the stack faults instead of 
+// silently corrupting the neighboring memory.  Costs up to two pages
+// per process.  (Not for use with reserved huge pages.)
+//#define STACK_GUARD
+
+#ifdef STACK_GUARD
+#define GUARD_PAGE_SIZE  4096
+#define STACK_EXTRA  (2 * GUARD_PAGE_SIZE)  // room for guard and alignment
+#else
+#define STACK_EXTRA  0
+#endif
+
 /** process descriptor */
 typedef struct Process  {
     Word *stackptr;             // pointer to top of stack 
@@ -85,8 +117,15 @@ typedef struct Process  {
     uint16 index;               // memory class of this process record  
     uint16 pri;                 // priority of this process               
     uint16 pun;                 // processor on which this process runs 
+    struct RegionChunk *region; // memory allocated by process (region.h)
+#if defined(STACK_CHECK) || defined(STACK_GUARD)
+    byte *stackbase;            // lowest address of stack proper
+    uint stacklen;              // length of stack proper (bytes)
+#endif
+    PROC_ALIGN
     _Atomic(uint8) alt_state;    // state when alting
     _Atomic(uint8) sched_state;  // scheduling state
+    PROC_ALIGN
     Word stack[];               // stack
 } Process;
 //Note: could get rid of 4 bytes in process record
@@ -98,11 +137,26 @@ typedef struct RdyQDesc {
     Process *head;       // first process in queue
 } RdyQDesc;
 
+/** Returns the most stack (bytes) the process has used so far, or 0
+ *  if not known (needs STACK_CHECK) */
+uint stack_high_water(Process *proc);
+
+/** Prints the process's stack usage (needs STACK_CHECK) */
+void print_stack_usage(Process *proc);
+
 /** Starts the run. 
  *  total:  size of total allocatable memory (bytes) 
  *  stacksize: stack size of initial process */
 void initialize(uint total, uint stacksize);
 
+/** Starts the run, with the application's own memory block sizes.
+ *  total:  size of total allocatable memory (bytes) 
+ *  stacksize: stack size of initial process 
+ *  sizes: allocatable block sizes (bytes), ascending, at most 23 
+ *  nsizes: number of sizes */
+void initialize_with_sizes(uint total, uint stacksize, 
+                               const uint32 sizes[], int nsizes);
+
 /** Potentially puts current process into waiting state and
  *  gives process to highest priority ready process.  */
 void relinquish();
@@ -136,6 +190,10 @@ void schedule(Process *proc);
  *  Interrupts must be disabled when calling this function. */
 void schedule0(Process *proc);
 
+/** Makes each process in the given chain (linked through 'next')
+ *  ready, interrupting each other processing unit only once. */
+void schedule_batch(Process *procs);
+
 /** Returns the highest priority ready process if it
  *  has priority higher than currently executing process
  *  and null otherwise. */
@@ -0,0 +1,183 @@
+
+/**
+ *  CXP   C eXecutive Program
+ *  Copyright (c) 2014 Michael E. Goldsby
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stream.h"
+#include "memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dbg.h"
+
+/** Makes waiting process ready */
+static void wake(Process *proc)
+{
+    int old_state = atomic_exchange_explicit(
+        &proc->sched_state, PROC_READY, memory_order_acq_rel);
+
+    // if process was waiting, schedule it
+    // (otherwise, state was PROC_PREPARING_TO_WAIT, and process 
+    // is either executing or already in its scheduling queue)
+    if (old_state == PROC_WAITING) {
+        schedule(proc);
+    }
+}
+
+/** Initializes stream with given ring size and longest view */
+void init_stream(Stream *s, uint capacity, uint maxview)
+{
+    if (capacity == 0) plotz("init_stream zero capacity");
+    if (maxview > capacity) plotz("init_stream view longer than ring");
+    init_mutex(&s->mutex);
+    s->capacity = capacity;
+    s->maxview = maxview;
+    s->index = find_mem_index(capacity + maxview);
+    s->buf = allocate_mem(s->index);
+    s->rpos = 0;
+    s->count = 0;
+    s->need = 0;
+    s->reader = NULL;
+    s->writer = NULL;
+}
+
+/** Waits (with the mutex held) until at least 'min' bytes are held */
+static void await_bytes(Stream *s, uint min)
+{
+    Process *curr = get_current();
+    while (s->count < min)
+    {
+        s->reader = curr;
+        s->need = min;
+        PREPARE_TO_WAIT(curr);
+        release_mutex(&s->mutex);   // release exclusive access
+        relinquish();
+        claim_mutex(&s->mutex);     // claim exclusive access
+    }
+}
+
+/** Discards first 'len' bytes (with the mutex held) and 
+ *  returns writer to free, if any */
+static Process *discard(Stream *s, uint len)
+{
+    s->rpos = (s->rpos + len) % s->capacity;
+    s->count -= len;
+    Process *writer = s->writer;
+    s->writer = NULL;
+    return writer;
+}
+
+/** Writes 'len' bytes, waiting for space as necessary */
+void stream_write(Stream *s, byte *src, uint len)
+{
+    Process *curr = get_current();
+    claim_mutex(&s->mutex);   // claim exclusive access to this stream
+    while (len > 0)
+    {
+        // wait for space
+        while (s->count == s->capacity)
+        {
+            s->writer = curr;
+            PREPARE_TO_WAIT(curr);
+            release_mutex(&s->mutex);   // release exclusive access
+            relinquish();
+            claim_mutex(&s->mutex);     // claim exclusive access
+        }
+
+        // copy as much as fits before the wrap point
+        uint wpos = (s->rpos + s->count) % s->capacity;
+        uint n = s->capacity - s->count;
+        if (n > s->capacity - wpos) n = s->capacity - wpos;
+        if (n > len) n = len;
+        memcpy(s->buf + wpos, src, n);
+
+        // keep the mirror of the ring's start up to date
+        if (wpos < s->maxview) {
+            uint m = (wpos + n <= s->maxview ? n : s->maxview - wpos);
+            memcpy(s->buf + s->capacity + wpos, src, m);
+        }
+        s->count += n;
+        src += n;
+        len -= n;
+
+        // if reader now has what it needs, free it
+        if (s->reader != NULL && s->count >= s->need) {
+            Process *reader = s->reader;
+            s->reader = NULL;
+            release_mutex(&s->mutex);   // release exclusive access
+            wake(reader);
+            claim_mutex(&s->mutex);     // claim exclusive access
+        }
+    }
+    release_mutex(&s->mutex);   // release exclusive access
+}
+
+/** Reads up to 'len' bytes, waiting only if none held; 
+ *  returns the number read */
+uint stream_read(Stream *s, byte *dest, uint len)
+{
+    if (len == 0) return 0;
+    claim_mutex(&s->mutex);   // claim exclusive access to this stream
+    await_bytes(s, 1);
+
+    // copy out, in two pieces if the bytes wrap
+    uint n = (len < s->count ? len : s->count);
+    uint first = s->capacity - s->rpos;
+    if (first >= n) {
+        memcpy(dest, s->buf + s->rpos, n);
+    } else {
+        memcpy(dest, s->buf + s->rpos, first);
+        memcpy(dest + first, s->buf, n - first);
+    }
+
+    Process *writer = discard(s, n);
+    release_mutex(&s->mutex);   // release exclusive access
+    if (writer != NULL) {
+        wake(writer);
+    }
+    return n;
+}
+
+/** Waits until at least 'min' bytes are held and returns 
+ *  a contiguous view of them */
+byte *stream_peek(Stream *s, uint min, uint *avail)
+{
+    if (min > s->maxview) plotz("stream_peek view too long");
+    claim_mutex(&s->mutex);   // claim exclusive access to this stream
+    await_bytes(s, (min > 0 ? min : 1));
+
+    // bytes past the end of the ring are in the mirror
+    uint n = (s->count < s->maxview ? s->count : s->maxview);
+    byte *view = s->buf + s->rpos;
+    release_mutex(&s->mutex);   // release exclusive access
+    // (the writer never overwrites held bytes, so
+    // the view stays valid until consumed)
+
+    *avail = n;
+    return view;
+}
+
+/** Discards the first 'len' bytes held */
+void stream_consume(Stream *s, uint len)
+{
+    claim_mutex(&s->mutex);   // claim exclusive access to this stream
+    if (len > s->count) plotz("stream_consume more than held");
+    Process *writer = discard(s, len);
+    release_mutex(&s->mutex);   // release exclusive access
+    if (writer != NULL) {
+        wake(writer);
+    }
+}
@@ -0,0 +1,72 @@
+
+/**
+ *  CXP   C eXecutive Program
+ *  Copyright (c) 2014 Michael E. Goldsby
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "mutex.h"
+#include "sched.h"
+#include "types.h"
+
+/*---------------------------------------------------------------------
+ |  A stream carries bytes from one writer to one reader, like a
+ |  pipe.  The writer writes any number of bytes and the reader reads
+ |  "up to n" bytes, so the two need not agree on lengths, and a 
+ |  write does not need a rendezvous of its own.  Bytes are held in
+ |  a ring buffer.
+ |
+ |  A reader may also look at the buffered bytes in place with 
+ |  stream_peek and then discard them with stream_consume.  The
+ |  view stream_peek returns never breaks at the wrap point of the
+ |  ring: the first 'maxview' bytes of the ring are mirrored just
+ |  past its end, so up to 'maxview' bytes starting anywhere are
+ |  contiguous.
+ *--------------------------------------------------------------------*/
+
+typedef struct Stream {
+    Mutex mutex;
+    byte *buf;             // ring, followed by mirror of its start
+    uint capacity;         // size of ring, in bytes
+    uint maxview;          // longest contiguous view
+    uint rpos;             // position of oldest byte in ring
+    uint count;            // number of bytes held
+    uint need;             // bytes the waiting reader needs
+    Process *reader;       // reader waiting for bytes
+    Process *writer;       // writer waiting for space
+    uint16 index;          // memory class of buffer
+} Stream;
+
+/** Initializes stream with given ring size and longest view */
+void init_stream(Stream *s, uint capacity, uint maxview);
+
+/** Writes 'len' bytes, waiting for space as necessary */
+void stream_write(Stream *s, byte *src, uint len);
+
+/** Reads up to 'len' bytes, waiting only if none held; 
+ *  returns the number read */
+uint stream_read(Stream *s, byte *dest, uint len);
+
+/** Waits until at least 'min' bytes are held (min <= maxview) and
+ *  returns a contiguous view of them; '*avail' receives the view 
+ *  length (at most maxview) */
+byte *stream_peek(Stream *s, uint min, uint *avail);
+
+/** Discards the first 'len' bytes held (after stream_peek) */
+void stream_consume(Stream *s, uint len);
+
+#endif
@@ -37,8 +37,9 @@ static Time Tick = 1000000000ULL;   // time units (nsec) per tick
 //static Time Tick = 1000000000000ULL;   // time units (nsec) per tick
 
 /** Timer list entry */
-#define TMO_AFTER   0
-#define TMO_ALTING  1
+#define TMO_AFTER     0
+#define TMO_ALTING    1
+#define TMO_DEADLINE  2
 typedef struct TimeoutDesc {
 
     Time time;               // time of expiration
@@ -197,6 +198,28 @@ void After(Time when)
     }
 }
 
+/** Relinquishes the processor until the current process is made
+ *  ready or the given deadline passes, whichever comes first.
+ *  The caller must already be preparing to wait. */
+void relinquish_until(Time deadline)
+{
+    int pun = getcpu();
+    Process *proc = get_current();
+    TimerQDesc *tque = timeQue + pun;
+    TimeoutDesc desc;
+    desc.time = deadline;
+    desc.proc = proc;
+    desc.type = TMO_DEADLINE;
+    desc.next = NULL;
+    insertInQueue(tque, &desc);
+    relinquish();
+    // when resume here, either someone made this process ready
+    // or the deadline passed; in the first case, the timeout is
+    // still queued, and must not fire once the process has
+    // gone on to wait for something else
+    removeFromQueue(tque, deadline, proc);
+}
+
 /** Returns true if timeout is ready */
 _Bool timeout_ready(Time time) 
 {
@@ -252,37 +275,6 @@ static void freeProcess(Process *proc)
     }
 }
 
-/** Frees alting process if appropriate */
-static void maybeFreeAltingProcess(Process *proc)
-{
-    // attempt transition from Enabling to Ready
-    uint8 expected = ALT_ENABLING;
-    _Bool successful = atomic_compare_exchange_strong_explicit(
-        &proc->alt_state, &expected, ALT_READY,
-        memory_order_acq_rel, memory_order_relaxed);
-    // if successful, the process is running, so can just return
-    // if not successful, the actual value may be Ready, Waiting
-    // or None.  If Ready, someone beat us to it and we can just
-    // return.  If None, the process is finished with the Alt
-    // and we can just return.
-            
-    // if found process waiting, attempt transition from
-    // Waiting to Ready
-    if (expected == ALT_WAITING) {
-        successful = atomic_compare_exchange_strong_explicit(
-            &proc->alt_state, &expected, ALT_READY,
-            memory_order_acq_rel, memory_order_relaxed);
-
-        // if successful, we found process waiting and need
-        // to put it on its ready queue
-        if (successful) {
-            enqueue0(proc);
-        }
-        // if not successful, someone already put the process
-        // in the ready state, so just return
-    }
-}
-
 /** Handles timer interrupt for timeouts */
 void handle_timeout_interrupt()
 {
@@ -305,8 +297,9 @@ void handle_timeout_interrupt()
         // this one is due, so remove it from queue
         removeHead(tque);    
 
-        // if an After requested this timeout, make waiting process ready
-        if (head->type == TMO_AFTER) {
+        // if an After or a deadline-bounded wait requested this 
+        // timeout, make waiting process ready
+        if (head->type == TMO_AFTER || head->type == TMO_DEADLINE) {
 
             freeProcess(head->proc);
 
@@ -314,7 +307,7 @@ void handle_timeout_interrupt()
         // if it isn't already ready
         } else if (head->type == TMO_ALTING) {
 
-            maybeFreeAltingProcess(head->proc);
+            freeProcessMaybe0(head->proc);
 
         }  else  plotz("handle_timeout_interrupt invalid type");
 
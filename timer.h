@@ -34,6 +34,9 @@ Time Now();   // synonym for GetCurrentTime
 /** Returns at given time */
 void After(Time when);
 
+/** Relinquishes processor until made ready or deadline passes */
+void relinquish_until(Time deadline);
+
 /** Returns true if timeout ready */
 _Bool timeout_ready(Time time);
 
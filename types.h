@@ -34,6 +34,8 @@ typedef unsigned int uint;
 typedef Word Addr;
 typedef int64 Time;
 #define MAX_TIME 0xffffffffffffffff
+#define CACHE_LINE_SIZE 64    // bytes per cache line
+#define CACHE_ALIGNED __attribute__((aligned(CACHE_LINE_SIZE)))
 
 /***
 #define uint16 short